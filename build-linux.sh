@@ -1,3 +1,8 @@
 set -xe
 
-clang++ -g -o example examples/generatingImage.cpp -I"." -lm
\ No newline at end of file
+clang++ -g -o example examples/generatingImage.cpp -I"." -lm -pthread
+clang++ -g -std=c++17 -o pyramid examples/pyramid.cpp -I"." -lm -pthread
+clang++ -g -o isaCheck examples/isaCheck.cpp -I"." -lm -pthread
+./isaCheck
+clang++ -g -o renderCheck examples/renderCheck.cpp -I"." -lm -pthread
+./renderCheck
\ No newline at end of file
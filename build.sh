@@ -1,3 +1,8 @@
 set -xe
 
-clang -g -o example.exe examples/generatingImage.cpp -I"."
\ No newline at end of file
+clang -g -o example.exe examples/generatingImage.cpp -I"."
+clang -g -std=c++17 -o pyramid.exe examples/pyramid.cpp -I"."
+clang -g -o isaCheck.exe examples/isaCheck.cpp -I"."
+./isaCheck.exe
+clang -g -o renderCheck.exe examples/renderCheck.cpp -I"."
+./renderCheck.exe
\ No newline at end of file
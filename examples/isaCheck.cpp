@@ -0,0 +1,275 @@
+// shapes would print every draw, check prints its own results
+#define UHM_NO_STDIO
+#define UHM_IMPLEMENTATION
+#include <uhm.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <stdint.h>
+
+/*
+    Renders same scenes with scalar kernels and with every instruction set this cpu supports and compares them, both plainly and occluded
+    fills and linear gradients have to match exactly, radial gradients use single precision sqrt so channels can differ by 1
+    returns non-zero when any pixel is further off than that
+*/
+
+void add_u8(std::vector<char>& vec, char val){
+    vec.push_back(val);
+}
+
+void add_f32(std::vector<char>& vec, float val){
+    uint32_t p1 = (*((uint32_t*)&val) >> 0 * 8);
+    uint32_t p2 = (*((uint32_t*)&val) >> 1 * 8);
+    uint32_t p3 = (*((uint32_t*)&val) >> 2 * 8);
+    uint32_t p4 = (*((uint32_t*)&val) >> 3 * 8);
+
+    vec.push_back(p1);
+    vec.push_back(p2);
+    vec.push_back(p3);
+    vec.push_back(p4);
+}
+
+void add_color(std::vector<char>& vec, uint32_t val){
+    uint32_t R = (val >> 0 * 8);
+    uint32_t G = (val >> 1 * 8);
+    uint32_t B = (val >> 2 * 8);
+    uint32_t A = (val >> 3 * 8);
+
+    vec.push_back((char)B);
+    vec.push_back((char)G);
+    vec.push_back((char)R);
+    vec.push_back((char)A);
+}
+
+void add_rectangle_filled(std::vector<char>& vec, float x, float y, float w, float h, uint32_t color){
+    add_u8(vec,'R');
+    add_f32(vec,x);
+    add_f32(vec,y);
+    add_f32(vec,w);
+    add_f32(vec,h);
+    add_u8(vec,'F');
+    add_color(vec,color);
+}
+
+void add_rectangle_linearGradient(std::vector<char>& vec, float x, float y, float w, float h, float px1, float py1, float px2, float py2, uint32_t color1, uint32_t color2){
+    add_u8(vec,'R');
+    add_f32(vec,x);
+    add_f32(vec,y);
+    add_f32(vec,w);
+    add_f32(vec,h);
+    add_u8(vec,'L');
+    add_f32(vec,px1);
+    add_f32(vec,py1);
+    add_f32(vec,px2);
+    add_f32(vec,py2);
+    add_color(vec,color1);
+    add_color(vec,color2);
+}
+
+void add_rectangle_circularGradient(std::vector<char>& vec, float x, float y, float w, float h, float cx, float cy, float radius, uint32_t color1, uint32_t color2){
+    add_u8(vec,'R');
+    add_f32(vec,x);
+    add_f32(vec,y);
+    add_f32(vec,w);
+    add_f32(vec,h);
+    add_u8(vec,'C');
+    add_f32(vec,cx);
+    add_f32(vec,cy);
+    add_f32(vec,radius);
+    add_color(vec,color1);
+    add_color(vec,color2);
+}
+
+void add_circle_linearGradient(std::vector<char>& vec, float x, float y, float r, float px1, float py1, float px2, float py2, uint32_t color1, uint32_t color2){
+    add_u8(vec,'C');
+    add_f32(vec,x);
+    add_f32(vec,y);
+    add_f32(vec,r);
+    add_u8(vec,'L');
+    add_f32(vec,px1);
+    add_f32(vec,py1);
+    add_f32(vec,px2);
+    add_f32(vec,py2);
+    add_color(vec,color1);
+    add_color(vec,color2);
+}
+
+void add_circle_circularGradient(std::vector<char>& vec, float x, float y, float r, float cx, float cy, float radius, uint32_t color1, uint32_t color2){
+    add_u8(vec,'C');
+    add_f32(vec,x);
+    add_f32(vec,y);
+    add_f32(vec,r);
+    add_u8(vec,'C');
+    add_f32(vec,cx);
+    add_f32(vec,cy);
+    add_f32(vec,radius);
+    add_color(vec,color1);
+    add_color(vec,color2);
+}
+
+void add_ellipse_circularGradient(std::vector<char>& vec, float x, float y, float rw, float rh, float cx, float cy, float radius, uint32_t color1, uint32_t color2){
+    add_u8(vec,'E');
+    add_f32(vec,x);
+    add_f32(vec,y);
+    add_f32(vec,rw);
+    add_f32(vec,rh);
+    add_u8(vec,'C');
+    add_f32(vec,cx);
+    add_f32(vec,cy);
+    add_f32(vec,radius);
+    add_color(vec,color1);
+    add_color(vec,color2);
+}
+
+void add_rotateModifier(std::vector<char>& vec, float radians){
+    add_u8(vec,'|');
+    add_f32(vec,radians);
+}
+
+void add_boilerplate(std::vector<char>& vec, uint32_t backgroundColor){
+    add_u8(vec,'U');
+    add_u8(vec,'H');
+    add_u8(vec,'M');
+    add_color(vec,backgroundColor);
+}
+
+struct Scene {
+    const char* name;
+    uint32_t width, height;
+    int tolerance;
+    std::vector<char> data;
+};
+
+/*
+    Narrow shapes 1 to 40 pixels wide starting at every offset, so vector kernels run only their head and tail or a few full steps
+*/
+Scene short_spans_scene(){
+    Scene scene = {"short spans", 509, 167, 1, {}};
+    add_boilerplate(scene.data, 0xFF203040);
+    for(int i = 0; i < 40; i++){
+        float x = (3.0f + i * 12.3f) / scene.width;
+        float w = (1.0f + i) / scene.width;
+        add_rectangle_filled(scene.data, x, 0.15f, w, 0.08f, 0xFF000000 | (i * 0x0A0B0C));
+        add_rectangle_linearGradient(scene.data, x, 0.35f, w, 0.08f, 0.0f, 0.0f, 1.0f, 0.3f, 0xFFFF0000, 0xFF0000FF);
+        add_rectangle_circularGradient(scene.data, x, 0.55f, w, 0.08f, 0.5f, 0.5f, 0.6f, 0xFF00FF00, 0xFFFF00FF);
+    }
+    // gradients whose ends fall inside the span, so it gets split into clamped head, lerped middle and clamped tail
+    add_rectangle_linearGradient(scene.data, 0.5f, 0.8f, 0.9f, 0.1f, 0.45f, 0.0f, 0.55f, 0.0f, 0xFF102030, 0xFFF0E0D0);
+    add_rectangle_linearGradient(scene.data, 0.5f, 0.92f, 0.9f, 0.05f, 0.6f, 0.0f, 0.3f, 0.0f, 0xFF00FFFF, 0xFFFF8000);
+    return scene;
+}
+
+/*
+    Rows wider than UHM_STREAM_THRESHOLD, odd width so every row starts at different alignment of streaming stores
+*/
+Scene streaming_scene(){
+    Scene scene = {"streaming fills", UHM_STREAM_THRESHOLD + 77, 23, 0, {}};
+    add_boilerplate(scene.data, 0xFF112233);
+    add_rectangle_filled(scene.data, 0.5f, 0.3f, 1.0f - 9.0f / scene.width, 0.2f, 0xFFAABBCC);
+    add_rectangle_linearGradient(scene.data, 0.5f, 0.75f, 1.0f, 0.3f, 0.1f, 0.0f, 0.9f, 0.0f, 0xFF000000, 0xFFFFFFFF);
+    return scene;
+}
+
+/*
+    Big rotated and round shapes with both gradient types
+*/
+Scene gradients_scene(){
+    Scene scene = {"gradients", 333, 257, 1, {}};
+    add_boilerplate(scene.data, 0xFF000000);
+    add_circle_circularGradient(scene.data, 0.3f, 0.3f, 0.25f, 0.4f, 0.6f, 0.7f, 0xFFFF0000, 0xFF0000FF);
+    add_circle_linearGradient(scene.data, 0.7f, 0.35f, 0.2f, 0.0f, 0.2f, 1.0f, 0.8f, 0xFF00FF00, 0xFFFF00FF);
+    add_rotateModifier(scene.data, 0.7f);
+    add_ellipse_circularGradient(scene.data, 0.5f, 0.7f, 0.4f, 0.15f, 0.3f, 0.5f, 0.4f, 0xFFFFFF00, 0xFF00FFFF);
+    add_rotateModifier(scene.data, -1.1f);
+    add_rectangle_linearGradient(scene.data, 0.25f, 0.75f, 0.3f, 0.2f, 0.0f, 1.0f, 1.0f, 0.0f, 0xFF804020, 0xFF20FF80);
+    return scene;
+}
+
+typedef int (*RenderFn)(const uhm_program* program, uint32_t width, uint32_t height, char* out);
+
+struct Renderer {
+    const char* name;
+    RenderFn render;
+};
+
+int main(){
+    std::vector<Scene> scenes;
+    scenes.push_back(short_spans_scene());
+    scenes.push_back(streaming_scene());
+    scenes.push_back(gradients_scene());
+
+    // occluded render goes through coverage mask kernels on top of span ones
+    Renderer renderers[] = {
+        {"render", uhm_render},
+        {"occluded", uhm_render_occluded},
+    };
+
+    // UHM_FORCE_ISA is only read when kernels get bound, so after binding once tables are swapped in directly
+    uhm_get_kernels();
+    int supported = uhm_detect_isa();
+    printf("best supported instruction set: %s\n", uhm_kernel_tables[supported].isa);
+
+    int failures = 0;
+    for(size_t s = 0; s < scenes.size(); s++){
+        Scene& scene = scenes[s];
+        uhm_program* program = uhm_compile(scene.data.data(), (uint32_t)scene.data.size());
+        if(program == NULL){
+            printf("%s: couldn't compile\n", scene.name);
+            failures++;
+            continue;
+        }
+
+        size_t bytes = (size_t)scene.width * scene.height * 4;
+        std::vector<unsigned char> expected(bytes), actual(bytes);
+        for(size_t r = 0; r < sizeof(renderers) / sizeof(renderers[0]); r++){
+            Renderer& renderer = renderers[r];
+            uhm_active_kernels = &uhm_kernel_tables[UHM_ISA_SCALAR];
+            if(renderer.render(program, scene.width, scene.height, (char*)expected.data()) < 0){
+                printf("%s: scalar %s failed\n", scene.name, renderer.name);
+                failures++;
+                continue;
+            }
+
+            for(int isa = UHM_ISA_SCALAR + 1; isa <= supported; isa++){
+                uhm_active_kernels = &uhm_kernel_tables[isa];
+                if(renderer.render(program, scene.width, scene.height, (char*)actual.data()) < 0){
+                    printf("%s: %s %s failed\n", scene.name, uhm_kernel_tables[isa].isa, renderer.name);
+                    failures++;
+                    continue;
+                }
+
+                int maxDiff = 0;
+                size_t badPixels = 0, firstBad = 0;
+                for(size_t i = 0; i < bytes; i += 4){
+                    int pixelDiff = 0;
+                    for(int c = 0; c < 4; c++){
+                        int diff = abs((int)expected[i + c] - (int)actual[i + c]);
+                        if(diff > pixelDiff) pixelDiff = diff;
+                    }
+                    if(pixelDiff > maxDiff) maxDiff = pixelDiff;
+                    if(pixelDiff > scene.tolerance){
+                        if(badPixels == 0) firstBad = i / 4;
+                        badPixels++;
+                    }
+                }
+
+                if(badPixels > 0){
+                    printf("%s: %s %s FAILED, %zu pixels off by more than %d, first at (%zu, %zu), max difference %d\n",
+                        scene.name, uhm_kernel_tables[isa].isa, renderer.name, badPixels, scene.tolerance, firstBad % scene.width, firstBad / scene.width, maxDiff);
+                    failures++;
+                }else{
+                    printf("%s: %s %s ok, max difference %d\n", scene.name, uhm_kernel_tables[isa].isa, renderer.name, maxDiff);
+                }
+            }
+        }
+        uhm_program_free(program);
+    }
+
+    if(failures > 0){
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
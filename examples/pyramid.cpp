@@ -0,0 +1,201 @@
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+// shapes would print every draw, tool prints its own errors
+#define UHM_NO_STDIO
+#define UHM_IMPLEMENTATION
+#include <uhm.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <filesystem>
+
+/*
+    Writes deep zoom (DZI) tile pyramid of uhm file
+    every level is rendered from the file at its own size with uhm_render_region, nothing is downsampled
+    tiles go to <output>_files/<level>/<col>_<row>.png, tiles that are only background are hard links to one file
+*/
+
+struct Tile {
+    uint32_t level;
+    uint32_t col, row;
+};
+
+struct Pyramid {
+    const uhm_program* program;
+    uint32_t backgroundColor;
+    uint32_t width, height;
+    uint32_t tileSize;
+    uint32_t maxLevel;
+    std::string filesDir;
+    std::vector<Tile> tiles;
+
+    std::atomic<size_t> nextTile;
+    std::atomic<size_t> blankTiles;
+    std::atomic<bool> failed;
+};
+
+uint32_t level_size(uint32_t size, uint32_t levelsBelowMax){
+    return (uint32_t)(((uint64_t)size + ((uint64_t)1 << levelsBelowMax) - 1) >> levelsBelowMax);
+}
+
+bool read_file(const char* path, std::vector<char>& out){
+    FILE* file = fopen(path, "rb");
+    if(file == NULL) return false;
+    char buffer[65536];
+    size_t got;
+    while((got = fread(buffer, 1, sizeof(buffer), file)) > 0) out.insert(out.end(), buffer, buffer + got);
+    fclose(file);
+    return true;
+}
+
+/*
+    Blank tiles of same size share one file, first thread to need it writes it
+*/
+bool write_blank_tile(Pyramid* pyramid, const std::vector<uint32_t>& pixels, uint32_t width, uint32_t height, const std::string& path){
+    std::string blankPath = pyramid->filesDir + "/blank_" + std::to_string(width) + "x" + std::to_string(height) + ".png";
+    std::error_code error;
+    if(!std::filesystem::exists(blankPath, error)){
+        std::string tempPath = blankPath + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        if(!stbi_write_png(tempPath.c_str(), width, height, 4, pixels.data(), width*4)) return false;
+        std::filesystem::rename(tempPath, blankPath, error);
+        // other thread could have won the race, its file is just as good
+        if(error){
+            std::filesystem::remove(tempPath, error);
+            if(!std::filesystem::exists(blankPath, error)) return false;
+        }
+    }
+    std::filesystem::create_hard_link(blankPath, path, error);
+    // filesystems without hard links get a copy
+    if(error) std::filesystem::copy_file(blankPath, path, std::filesystem::copy_options::overwrite_existing, error);
+    return !error;
+}
+
+void render_tiles(Pyramid* pyramid){
+    std::vector<uint32_t> pixels((size_t)pyramid->tileSize * pyramid->tileSize);
+    while(!pyramid->failed){
+        size_t index = pyramid->nextTile++;
+        if(index >= pyramid->tiles.size()) return;
+        const Tile& tile = pyramid->tiles[index];
+
+        uint32_t levelWidth = level_size(pyramid->width, pyramid->maxLevel - tile.level);
+        uint32_t levelHeight = level_size(pyramid->height, pyramid->maxLevel - tile.level);
+        uint32_t x0 = tile.col * pyramid->tileSize;
+        uint32_t y0 = tile.row * pyramid->tileSize;
+        uint32_t width = levelWidth - x0 < pyramid->tileSize ? levelWidth - x0 : pyramid->tileSize;
+        uint32_t height = levelHeight - y0 < pyramid->tileSize ? levelHeight - y0 : pyramid->tileSize;
+
+        if(uhm_render_region(pyramid->program, levelWidth, levelHeight, x0, y0, width, height, (char*)pixels.data()) < 0){
+            printf("couldn't render tile %u/%u_%u\n", tile.level, tile.col, tile.row);
+            pyramid->failed = true;
+            return;
+        }
+
+        std::string path = pyramid->filesDir + "/" + std::to_string(tile.level) + "/" + std::to_string(tile.col) + "_" + std::to_string(tile.row) + ".png";
+        // tile left by earlier run could be a link to blank file, writing through it would change every blank tile
+        std::error_code error;
+        std::filesystem::remove(path, error);
+        bool blank = true;
+        for(size_t i = 0; i < (size_t)width * height && blank; i++) blank = pixels[i] == pyramid->backgroundColor;
+
+        bool written;
+        if(blank){
+            written = write_blank_tile(pyramid, pixels, width, height, path);
+            pyramid->blankTiles++;
+        }else{
+            written = stbi_write_png(path.c_str(), width, height, 4, pixels.data(), width*4) != 0;
+        }
+        if(!written){
+            printf("couldn't write %s\n", path.c_str());
+            pyramid->failed = true;
+            return;
+        }
+    }
+}
+
+int main(int argc, char** argv){
+    if(argc < 5){
+        printf("usage: %s <input.uhm> <output> <width> <height> [tile size = 256] [threads = all cpus]\n", argv[0]);
+        printf("writes <output>.dzi and tiles into <output>_files\n");
+        return 1;
+    }
+
+    std::vector<char> data;
+    if(!read_file(argv[1], data)){
+        printf("couldn't read %s\n", argv[1]);
+        return 1;
+    }
+
+    uhm_program* program = uhm_compile(data.data(), data.size());
+    if(program == nullptr){
+        printf("an error occured! couldn't parse %s\n", argv[1]);
+        return 1;
+    }
+
+    Pyramid pyramid;
+    pyramid.program = program;
+    pyramid.backgroundColor = uhm_program_background_color(program);
+    pyramid.width = (uint32_t)strtoul(argv[3], NULL, 10);
+    pyramid.height = (uint32_t)strtoul(argv[4], NULL, 10);
+    pyramid.tileSize = argc > 5 ? (uint32_t)strtoul(argv[5], NULL, 10) : 256;
+    uint32_t threadCount = argc > 6 ? (uint32_t)strtoul(argv[6], NULL, 10) : std::thread::hardware_concurrency();
+    if(threadCount == 0) threadCount = 1;
+    if(pyramid.width == 0 || pyramid.height == 0 || pyramid.tileSize == 0){
+        printf("width, height and tile size have to be positive\n");
+        uhm_program_free(program);
+        return 1;
+    }
+    pyramid.filesDir = std::string(argv[2]) + "_files";
+    pyramid.nextTile = 0;
+    pyramid.blankTiles = 0;
+    pyramid.failed = false;
+
+    // level maxLevel is full size, every level below is half of one above rounded up, level 0 is 1x1
+    uint32_t largest = pyramid.width > pyramid.height ? pyramid.width : pyramid.height;
+    pyramid.maxLevel = 0;
+    while(((uint64_t)1 << pyramid.maxLevel) < largest) pyramid.maxLevel++;
+
+    for(uint32_t level = 0; level <= pyramid.maxLevel; level++){
+        std::error_code error;
+        std::filesystem::create_directories(pyramid.filesDir + "/" + std::to_string(level), error);
+        if(error){
+            printf("couldn't create %s/%u\n", pyramid.filesDir.c_str(), level);
+            uhm_program_free(program);
+            return 1;
+        }
+        uint32_t cols = (level_size(pyramid.width, pyramid.maxLevel - level) + pyramid.tileSize - 1) / pyramid.tileSize;
+        uint32_t rows = (level_size(pyramid.height, pyramid.maxLevel - level) + pyramid.tileSize - 1) / pyramid.tileSize;
+        for(uint32_t row = 0; row < rows; row++){
+            for(uint32_t col = 0; col < cols; col++) pyramid.tiles.push_back({level, col, row});
+        }
+    }
+
+    std::vector<std::thread> threads;
+    for(uint32_t i = 0; i < threadCount; i++) threads.emplace_back(render_tiles, &pyramid);
+    for(std::thread& thread : threads) thread.join();
+    uhm_program_free(program);
+    if(pyramid.failed) return 1;
+
+    std::string descriptorPath = std::string(argv[2]) + ".dzi";
+    FILE* descriptor = fopen(descriptorPath.c_str(), "wb");
+    if(descriptor == NULL){
+        printf("couldn't write %s\n", descriptorPath.c_str());
+        return 1;
+    }
+    fprintf(descriptor,
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\" TileSize=\"%u\" Overlap=\"0\" Format=\"png\">\n"
+        "    <Size Width=\"%u\" Height=\"%u\"/>\n"
+        "</Image>\n",
+        pyramid.tileSize, pyramid.width, pyramid.height
+    );
+    fclose(descriptor);
+
+    printf("%zu tiles in %u levels, %zu of them blank\n", pyramid.tiles.size(), pyramid.maxLevel + 1, (size_t)pyramid.blankTiles);
+    return 0;
+}
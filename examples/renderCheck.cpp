@@ -0,0 +1,646 @@
+// shapes would print every draw, check prints its own results
+#define UHM_NO_STDIO
+#define UHM_IMPLEMENTATION
+#include <uhm.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <stdint.h>
+
+/*
+    Renders same scenes with uhm_render and with every other way of rendering a program and compares them
+    all of them promise output identical to uhm_render, so any differing byte is a failure
+    every scene is checked on square and non square canvases, once as compiled and once after uhm_program_flatten(program, 0)
+    so both flat instance list and walking patterns get covered
+    uhm_render_cached is only close to uhm_render, so it gets bounds on how many pixels change instead
+    returns non-zero when any check fails
+*/
+
+void add_u8(std::vector<char>& vec, char val){
+    vec.push_back(val);
+}
+
+void add_u16(std::vector<char>& vec, uint16_t val){
+    uint16_t p1 = (val >> 0 * 8);
+    uint16_t p2 = (val >> 1 * 8);
+
+    vec.push_back((char)p1);
+    vec.push_back((char)p2);
+}
+
+void add_f32(std::vector<char>& vec, float val){
+    uint32_t p1 = (*((uint32_t*)&val) >> 0 * 8);
+    uint32_t p2 = (*((uint32_t*)&val) >> 1 * 8);
+    uint32_t p3 = (*((uint32_t*)&val) >> 2 * 8);
+    uint32_t p4 = (*((uint32_t*)&val) >> 3 * 8);
+
+    vec.push_back(p1);
+    vec.push_back(p2);
+    vec.push_back(p3);
+    vec.push_back(p4);
+}
+
+void add_color(std::vector<char>& vec, uint32_t val){
+    uint32_t R = (val >> 0 * 8);
+    uint32_t G = (val >> 1 * 8);
+    uint32_t B = (val >> 2 * 8);
+    uint32_t A = (val >> 3 * 8);
+
+    vec.push_back((char)B);
+    vec.push_back((char)G);
+    vec.push_back((char)R);
+    vec.push_back((char)A);
+}
+
+void add_rectangle_filled(std::vector<char>& vec, float x, float y, float w, float h, uint32_t color){
+    add_u8(vec,'R');
+    add_f32(vec,x);
+    add_f32(vec,y);
+    add_f32(vec,w);
+    add_f32(vec,h);
+    add_u8(vec,'F');
+    add_color(vec,color);
+}
+
+void add_rectangle_linearGradient(std::vector<char>& vec, float x, float y, float w, float h, float px1, float py1, float px2, float py2, uint32_t color1, uint32_t color2){
+    add_u8(vec,'R');
+    add_f32(vec,x);
+    add_f32(vec,y);
+    add_f32(vec,w);
+    add_f32(vec,h);
+    add_u8(vec,'L');
+    add_f32(vec,px1);
+    add_f32(vec,py1);
+    add_f32(vec,px2);
+    add_f32(vec,py2);
+    add_color(vec,color1);
+    add_color(vec,color2);
+}
+
+void add_rectangle_circularGradient(std::vector<char>& vec, float x, float y, float w, float h, float cx, float cy, float radius, uint32_t color1, uint32_t color2){
+    add_u8(vec,'R');
+    add_f32(vec,x);
+    add_f32(vec,y);
+    add_f32(vec,w);
+    add_f32(vec,h);
+    add_u8(vec,'C');
+    add_f32(vec,cx);
+    add_f32(vec,cy);
+    add_f32(vec,radius);
+    add_color(vec,color1);
+    add_color(vec,color2);
+}
+
+void add_circle_linearGradient(std::vector<char>& vec, float x, float y, float r, float px1, float py1, float px2, float py2, uint32_t color1, uint32_t color2){
+    add_u8(vec,'C');
+    add_f32(vec,x);
+    add_f32(vec,y);
+    add_f32(vec,r);
+    add_u8(vec,'L');
+    add_f32(vec,px1);
+    add_f32(vec,py1);
+    add_f32(vec,px2);
+    add_f32(vec,py2);
+    add_color(vec,color1);
+    add_color(vec,color2);
+}
+
+void add_circle_circularGradient(std::vector<char>& vec, float x, float y, float r, float cx, float cy, float radius, uint32_t color1, uint32_t color2){
+    add_u8(vec,'C');
+    add_f32(vec,x);
+    add_f32(vec,y);
+    add_f32(vec,r);
+    add_u8(vec,'C');
+    add_f32(vec,cx);
+    add_f32(vec,cy);
+    add_f32(vec,radius);
+    add_color(vec,color1);
+    add_color(vec,color2);
+}
+
+void add_ellipse_circularGradient(std::vector<char>& vec, float x, float y, float rw, float rh, float cx, float cy, float radius, uint32_t color1, uint32_t color2){
+    add_u8(vec,'E');
+    add_f32(vec,x);
+    add_f32(vec,y);
+    add_f32(vec,rw);
+    add_f32(vec,rh);
+    add_u8(vec,'C');
+    add_f32(vec,cx);
+    add_f32(vec,cy);
+    add_f32(vec,radius);
+    add_color(vec,color1);
+    add_color(vec,color2);
+}
+
+void add_rotateModifier(std::vector<char>& vec, float radians){
+    add_u8(vec,'|');
+    add_f32(vec,radians);
+}
+
+void add_circle_filled(std::vector<char>& vec, float x, float y, float r, uint32_t color){
+    add_u8(vec,'C');
+    add_f32(vec,x);
+    add_f32(vec,y);
+    add_f32(vec,r);
+    add_u8(vec,'F');
+    add_color(vec,color);
+}
+
+void add_ellipse_filled(std::vector<char>& vec, float x, float y, float rw, float rh, uint32_t color){
+    add_u8(vec,'E');
+    add_f32(vec,x);
+    add_f32(vec,y);
+    add_f32(vec,rw);
+    add_f32(vec,rh);
+    add_u8(vec,'F');
+    add_color(vec,color);
+}
+
+void add_tiledPattern_startClause(std::vector<char>& vec,float gx, float gy, float ox, float oy, uint16_t rows, uint16_t cols){
+    add_u8(vec,'T');
+    add_f32(vec,gx);
+    add_f32(vec,gy);
+    add_f32(vec,ox);
+    add_f32(vec,oy);
+    add_u16(vec,rows);
+    add_u16(vec,cols);
+}
+
+void add_definePattern_startClause(std::vector<char>& vec, uint16_t patternID){
+    add_u8(vec, 'P');
+    add_u8(vec, 'R');
+    add_u16(vec, patternID);
+}
+
+void add_endClause(std::vector<char>& vec){
+    add_u8(vec,']');
+}
+
+void add_scaleModifier(std::vector<char>& vec, float scale){
+    add_u8(vec,'\\');
+    add_f32(vec,scale);
+}
+
+void add_placePattern(std::vector<char>& vec, uint16_t patternID, float x, float y){
+    add_u8(vec, 'P');
+    add_u8(vec, 'P');
+    add_u16(vec, patternID);
+    add_f32(vec, x);
+    add_f32(vec, y);
+}
+
+void add_boilerplate(std::vector<char>& vec, uint32_t backgroundColor){
+    add_u8(vec,'U');
+    add_u8(vec,'H');
+    add_u8(vec,'M');
+    add_color(vec,backgroundColor);
+}
+
+struct Scene {
+    const char* name;
+    std::vector<char> data;
+};
+
+/*
+    Overlapping shapes of every kind, some rotated and some sticking out of canvas
+*/
+Scene layered_scene(){
+    Scene scene = {"layered shapes", {}};
+    add_boilerplate(scene.data, 0xFF101820);
+    uint32_t seed = 12345;
+    for(int i = 0; i < 60; i++){
+        seed = seed * 1664525u + 1013904223u;
+        float x = (float)(seed >> 8 & 1023) / 900.0f - 0.05f;
+        float y = (float)(seed >> 18 & 1023) / 900.0f - 0.05f;
+        float s = 0.02f + (float)(seed & 255) / 1200.0f;
+        uint32_t color = 0xFF000000 | (seed * 2654435761u >> 8);
+        if(i % 7 == 3) add_rotateModifier(scene.data, 0.3f * i);
+        switch(i % 6){
+            case 0: add_rectangle_filled(scene.data, x, y, s * 2, s, color); break;
+            case 1: add_circle_filled(scene.data, x, y, s, color); break;
+            case 2: add_ellipse_filled(scene.data, x, y, s, s * 0.5f, color); break;
+            case 3: add_rectangle_linearGradient(scene.data, x, y, s, s * 3, 0.0f, 0.0f, 1.0f, 1.0f, color, ~color | 0xFF000000); break;
+            case 4: add_circle_circularGradient(scene.data, x, y, s, 0.5f, 0.5f, 0.5f, color, 0xFFFFFFFF); break;
+            case 5: add_ellipse_circularGradient(scene.data, x, y, s * 0.7f, s * 1.5f, 0.3f, 0.6f, 0.4f, color, 0xFF000000); break;
+        }
+    }
+    return scene;
+}
+
+/*
+    Tiled patterns nested in each other, rotated and scaled, cells partly outside of canvas
+*/
+Scene tiled_scene(){
+    Scene scene = {"tiled patterns", {}};
+    add_boilerplate(scene.data, 0xFF000000);
+    add_tiledPattern_startClause(scene.data, -0.05f, -0.05f, 0.3f, 0.3f, 4, 4);
+        add_tiledPattern_startClause(scene.data, 0.0f, 0.0f, 0.12f, 0.12f, 2, 2);
+            add_rectangle_linearGradient(scene.data, 0.05f, 0.05f, 0.1f, 0.1f, 0.0f, 0.0f, 1.0f, 1.0f, 0xFFFF00FF, 0xFF00FF00);
+        add_endClause(scene.data);
+        add_circle_filled(scene.data, 0.2f, 0.2f, 0.04f, 0xFF3080F0);
+    add_endClause(scene.data);
+    add_rotateModifier(scene.data, 0.4f);
+    add_tiledPattern_startClause(scene.data, 0.5f, 0.5f, 0.07f, 0.09f, 5, 6);
+        add_ellipse_circularGradient(scene.data, 0.0f, 0.0f, 0.03f, 0.015f, 0.5f, 0.5f, 0.5f, 0xFFFFFF00, 0xFF0000FF);
+    add_endClause(scene.data);
+    add_scaleModifier(scene.data, 0.6f);
+    add_tiledPattern_startClause(scene.data, 0.6f, 0.05f, 0.1f, 0.1f, 3, 7);
+        add_rectangle_filled(scene.data, 0.0f, 0.0f, 0.06f, 0.03f, 0xFFE0E0E0);
+    add_endClause(scene.data);
+    return scene;
+}
+
+/*
+    Defined patterns placed with rotations and scales, also from inside of a tiled pattern
+*/
+Scene pattern_scene(){
+    Scene scene = {"patterns", {}};
+    add_boilerplate(scene.data, 0xFF204060);
+    add_definePattern_startClause(scene.data, 69);
+        add_circle_circularGradient(scene.data, 0.0f, 0.0f, 0.1f, 0.5f, 0.5f, 0.5f, 0xFFFF00FF, 0xFF00FF00);
+        add_rotateModifier(scene.data, UHM_PI / 4);
+        add_rectangle_linearGradient(scene.data, 0.0f, -0.15f, 0.2f, 0.2f, 0.0f, 0.0f, 1.0f, 1.0f, 0xFFFF00FF, 0xFFFFFF00);
+    add_endClause(scene.data);
+    add_definePattern_startClause(scene.data, 7);
+        add_rectangle_filled(scene.data, 0.0f, 0.0f, 0.05f, 0.05f, 0xFF40C0A0);
+        add_placePattern(scene.data, 69, 0.03f, 0.03f);
+    add_endClause(scene.data);
+
+    add_rotateModifier(scene.data, -UHM_PI / 2);
+    add_placePattern(scene.data, 69, 0.25f, 0.25f);
+    add_rotateModifier(scene.data, UHM_PI / 8);
+    add_placePattern(scene.data, 69, 0.25f, 0.65f);
+    add_scaleModifier(scene.data, 0.5f);
+    add_placePattern(scene.data, 7, 0.75f, 0.2f);
+    add_scaleModifier(scene.data, 1.7f);
+    add_placePattern(scene.data, 69, 0.8f, 0.8f);
+    add_tiledPattern_startClause(scene.data, 0.1f, 0.85f, 0.15f, 0.1f, 2, 5);
+        add_placePattern(scene.data, 7, 0.0f, 0.0f);
+    add_endClause(scene.data);
+    return scene;
+}
+
+/*
+    Big grid of small cells, many instances that land in many tiles and bands
+*/
+Scene wallpaper_scene(){
+    Scene scene = {"wallpaper", {}};
+    add_boilerplate(scene.data, 0xFFFFFFFF);
+    add_tiledPattern_startClause(scene.data, 0.0f, 0.0f, 0.025f, 0.025f, 40, 40);
+        add_circle_linearGradient(scene.data, 0.0125f, 0.0125f, 0.01f, 0.0f, 0.0f, 1.0f, 1.0f, 0xFF800000, 0xFF0080FF);
+        add_rectangle_filled(scene.data, 0.02f, 0.02f, 0.006f, 0.006f, 0xFF000000);
+    add_endClause(scene.data);
+    return scene;
+}
+
+/*
+    Grids whose cells are whole pixels apart on some of canvases, renders walking patterns draw most of their cells as copies of first one
+*/
+Scene whole_pixel_scene(){
+    Scene scene = {"whole pixel grids", {}};
+    add_boilerplate(scene.data, 0xFF302010);
+    add_tiledPattern_startClause(scene.data, 1.0f / 32, 1.0f / 64, 1.0f / 16, 1.0f / 16, 14, 15);
+        add_rectangle_linearGradient(scene.data, 1.0f / 64, 1.0f / 64, 3.0f / 64, 1.0f / 32, 0.0f, 0.0f, 1.0f, 1.0f, 0xFFFF8000, 0xFF0080FF);
+        add_circle_circularGradient(scene.data, 1.0f / 32, 1.0f / 32, 1.0f / 64, 0.5f, 0.5f, 0.5f, 0xFFFFFFFF, 0xFF000000);
+        add_rotateModifier(scene.data, 0.5f);
+        add_ellipse_filled(scene.data, 3.0f / 128, 1.0f / 128, 1.0f / 64, 1.0f / 128, 0xFF20C040);
+    add_endClause(scene.data);
+    add_tiledPattern_startClause(scene.data, 0.1f, 0.2f, 24.0f / 317, 16.0f / 211, 8, 9);
+        add_rectangle_filled(scene.data, 0.0f, 0.0f, 0.05f, 0.04f, 0xFFC0C0FF);
+        add_ellipse_circularGradient(scene.data, 0.02f, 0.03f, 0.03f, 0.02f, 0.3f, 0.6f, 0.5f, 0xFF804000, 0xFFFFFF80);
+    add_endClause(scene.data);
+    return scene;
+}
+
+typedef int (*RenderFn)(const uhm_program* program, uint32_t width, uint32_t height, char* out);
+
+struct Renderer {
+    const char* name;
+    RenderFn render;
+};
+
+int render_parallel_1(const uhm_program* program, uint32_t width, uint32_t height, char* out){
+    return uhm_render_parallel(program, width, height, out, 1);
+}
+
+int render_parallel_4(const uhm_program* program, uint32_t width, uint32_t height, char* out){
+    return uhm_render_parallel(program, width, height, out, 4);
+}
+
+int render_indexed_1(const uhm_program* program, uint32_t width, uint32_t height, char* out){
+    return uhm_render_indexed(program, width, height, out, 1);
+}
+
+int render_indexed_4(const uhm_program* program, uint32_t width, uint32_t height, char* out){
+    return uhm_render_indexed(program, width, height, out, 4);
+}
+
+struct Bands {
+    char* out;
+    uint32_t width;
+    uint32_t nextRow;
+};
+
+int copy_band(void* user, const char* pixels, uint32_t firstRow, uint32_t rowCount){
+    Bands* bands = (Bands*)user;
+    // bands have to come in order and without gaps
+    if(firstRow != bands->nextRow) return -1;
+    memcpy(bands->out + (size_t)firstRow * bands->width * 4, pixels, (size_t)rowCount * bands->width * 4);
+    bands->nextRow += rowCount;
+    return 0;
+}
+
+int render_banded(const uhm_program* program, uint32_t width, uint32_t height, char* out, uint32_t bandHeight){
+    Bands bands = {out, width, 0};
+    int e = uhm_render_banded(program, width, height, bandHeight, copy_band, &bands);
+    if(e < 0) return e;
+    return bands.nextRow == height ? 0 : -1;
+}
+
+int render_banded_odd(const uhm_program* program, uint32_t width, uint32_t height, char* out){
+    return render_banded(program, width, height, out, 37);
+}
+
+int render_banded_default(const uhm_program* program, uint32_t width, uint32_t height, char* out){
+    return render_banded(program, width, height, out, 0);
+}
+
+// tiles that don't divide canvas, so edge tiles are partial
+int render_region_tiles(const uhm_program* program, uint32_t width, uint32_t height, char* out){
+    const uint32_t tileWidth = 64, tileHeight = 48;
+    std::vector<char> tile((size_t)tileWidth * tileHeight * 4);
+    for(uint32_t y0 = 0; y0 < height; y0 += tileHeight){
+        for(uint32_t x0 = 0; x0 < width; x0 += tileWidth){
+            uint32_t w = width - x0 < tileWidth ? width - x0 : tileWidth;
+            uint32_t h = height - y0 < tileHeight ? height - y0 : tileHeight;
+            int e = uhm_render_region(program, width, height, x0, y0, w, h, tile.data());
+            if(e < 0) return e;
+            for(uint32_t row = 0; row < h; row++){
+                memcpy(out + ((size_t)(y0 + row) * width + x0) * 4, tile.data() + (size_t)row * w * 4, (size_t)w * 4);
+            }
+        }
+    }
+    return 0;
+}
+
+// padding has to stay untouched
+int render_into_padded(const uhm_program* program, uint32_t width, uint32_t height, char* out){
+    const size_t padding = 36;
+    size_t stride = (size_t)width * 4 + padding;
+    std::vector<char> padded(stride * height, (char)0x5A);
+    int e = uhm_render_into(program, width, height, padded.data(), stride);
+    if(e < 0) return e;
+    for(uint32_t row = 0; row < height; row++){
+        const char* line = padded.data() + row * stride;
+        for(size_t i = (size_t)width * 4; i < stride; i++){
+            if(line[i] != (char)0x5A) return -1;
+        }
+        memcpy(out + (size_t)row * width * 4, line, (size_t)width * 4);
+    }
+    return 0;
+}
+
+/*
+    Sprites snap placements to quarter of pixel, so edges flip whole pixels and gradient samples move inside of every placement
+    pixels changed at all and pixels changed by more than CACHED_FLIP levels in some channel are bounded separately
+    rendering again through same cache, after it dropped or kept sprites, has to give same bytes
+*/
+#define CACHED_FLIP 32
+const double cachedChangedLimit = 0.45;
+const double cachedFlippedLimit = 0.08;
+
+int check_cached(const Scene& scene, const uhm_program* program, uint32_t width, uint32_t height, const std::vector<unsigned char>& expected, uhm_sprite_cache* cache, const char* name){
+    size_t bytes = expected.size();
+    std::vector<unsigned char> first(bytes), second(bytes);
+    if(
+        uhm_render_cached(program, width, height, (char*)first.data(), cache) < 0 ||
+        uhm_render_cached(program, width, height, (char*)second.data(), cache) < 0
+    ){
+        printf("%s %ux%u: %s failed\n", scene.name, width, height, name);
+        return 1;
+    }
+    if(first != second){
+        printf("%s %ux%u: %s FAILED, second render through same cache differs from first\n", scene.name, width, height, name);
+        return 1;
+    }
+
+    size_t changed = 0, flipped = 0;
+    for(size_t i = 0; i < bytes; i += 4){
+        int pixelDiff = 0;
+        for(int c = 0; c < 4; c++){
+            int diff = abs((int)expected[i + c] - (int)first[i + c]);
+            if(diff > pixelDiff) pixelDiff = diff;
+        }
+        if(pixelDiff > 0) changed++;
+        if(pixelDiff > CACHED_FLIP) flipped++;
+    }
+
+    double pixels = (double)width * height;
+    if(changed / pixels > cachedChangedLimit || flipped / pixels > cachedFlippedLimit){
+        printf("%s %ux%u: %s FAILED, %.1f%% of pixels changed (limit %.1f%%), %.1f%% by more than %d (limit %.1f%%)\n",
+            scene.name, width, height, name, 100 * changed / pixels, 100 * cachedChangedLimit, 100 * flipped / pixels, CACHED_FLIP, 100 * cachedFlippedLimit);
+        return 1;
+    }
+    printf("%s %ux%u: %s ok, %.1f%% of pixels changed, %.1f%% by more than %d\n", scene.name, width, height, name, 100 * changed / pixels, 100 * flipped / pixels, CACHED_FLIP);
+    return 0;
+}
+
+struct Random {
+    uint32_t state;
+
+    uint32_t next(){
+        state = state * 1664525u + 1013904223u;
+        return state >> 8;
+    }
+
+    float between(float a, float b){
+        return a + (b - a) * (float)(next() % 100000) / 100000.0f;
+    }
+
+    uint32_t color(){
+        return 0xFF000000 | (next() & 0xFFFFFF);
+    }
+};
+
+void add_random_shape(std::vector<char>& vec, Random& random){
+    if(random.next() % 4 == 0) add_rotateModifier(vec, random.between(-3.0f, 3.0f));
+    if(random.next() % 5 == 0) add_scaleModifier(vec, random.between(0.5f, 2.0f));
+    float x = random.between(-0.05f, 0.15f), y = random.between(-0.05f, 0.15f);
+    float a = random.between(0.005f, 0.12f), b = random.between(0.005f, 0.12f);
+    switch(random.next() % 6){
+        case 0: add_rectangle_filled(vec, x, y, a, b, random.color()); break;
+        case 1: add_circle_filled(vec, x, y, a, random.color()); break;
+        case 2: add_ellipse_filled(vec, x, y, a, b, random.color()); break;
+        case 3: add_rectangle_linearGradient(vec, x, y, a, b, random.between(-1, 2), random.between(-1, 2), random.between(-1, 2), random.between(-1, 2), random.color(), random.color()); break;
+        case 4: add_circle_circularGradient(vec, x, y, a, random.between(0, 1), random.between(0, 1), random.between(0.1f, 1), random.color(), random.color()); break;
+        case 5: add_ellipse_circularGradient(vec, x, y, a, b, random.between(0, 1), random.between(0, 1), random.between(0.1f, 1), random.color(), random.color()); break;
+    }
+}
+
+/*
+    Grids of random shapes with steps of whole pixels on canvas they're drawn on, often nested
+    float rounding moves shapes of only some cells exactly whole pixels apart, cells that are merely close mustn't become copies
+    pattern walking render of every grid has to match flat one exactly
+*/
+int check_random_grids(int count){
+    Random random = {4242};
+    int failures = 0;
+    for(int k = 0; k < count; k++){
+        uint32_t width = 64 + random.next() % 400;
+        uint32_t height = random.next() % 3 == 0 ? width : 64 + random.next() % 400;
+        std::vector<char> data;
+        add_boilerplate(data, random.color());
+        int grids = 1 + random.next() % 3;
+        for(int g = 0; g < grids; g++){
+            if(random.next() % 4 == 0) add_scaleModifier(data, random.next() % 2 ? 0.5f : 2.0f);
+            float ox = (float)(4 + random.next() % 60) / width;
+            float oy = (float)(4 + random.next() % 60) / height;
+            add_tiledPattern_startClause(data, random.between(-0.2f, 0.5f), random.between(-0.2f, 0.5f), ox, oy, 1 + random.next() % 12, 1 + random.next() % 12);
+            int children = 1 + random.next() % 4;
+            for(int c = 0; c < children; c++){
+                if(random.next() % 6 == 0){
+                    add_tiledPattern_startClause(data, random.between(0, 0.05f), random.between(0, 0.05f), (float)(2 + random.next() % 9) / width, (float)(2 + random.next() % 9) / height, 1 + random.next() % 3, 1 + random.next() % 3);
+                    add_random_shape(data, random);
+                    add_endClause(data);
+                }else{
+                    add_random_shape(data, random);
+                }
+            }
+            add_endClause(data);
+        }
+
+        uhm_program* program = uhm_compile(data.data(), (uint32_t)data.size());
+        if(program == NULL){
+            printf("random grid %d: couldn't compile\n", k);
+            failures++;
+            continue;
+        }
+        size_t bytes = (size_t)width * height * 4;
+        std::vector<unsigned char> flat(bytes), walked(bytes);
+        int e = uhm_render(program, width, height, (char*)flat.data());
+        uhm_program_flatten(program, 0);
+        if(e < 0 || uhm_render(program, width, height, (char*)walked.data()) < 0){
+            printf("random grid %d %ux%u: render failed\n", k, width, height);
+            failures++;
+        }else if(flat != walked){
+            size_t badPixels = 0;
+            for(size_t i = 0; i < bytes; i += 4) badPixels += memcmp(&flat[i], &walked[i], 4) != 0;
+            printf("random grid %d %ux%u: unflattened render FAILED, %zu pixels differ from flat one\n", k, width, height, badPixels);
+            failures++;
+        }
+        uhm_program_free(program);
+    }
+    if(failures == 0) printf("%d random grids match\n", count);
+    return failures;
+}
+
+int main(){
+    std::vector<Scene> scenes;
+    scenes.push_back(layered_scene());
+    scenes.push_back(tiled_scene());
+    scenes.push_back(pattern_scene());
+    scenes.push_back(wallpaper_scene());
+    scenes.push_back(whole_pixel_scene());
+
+    uint32_t sizes[][2] = {
+        {256, 256},
+        {317, 211},
+        {123, 400},
+    };
+
+    Renderer renderers[] = {
+        {"parallel 1", render_parallel_1},
+        {"parallel 4", render_parallel_4},
+        {"indexed 1", render_indexed_1},
+        {"indexed 4", render_indexed_4},
+        {"occluded", uhm_render_occluded},
+        {"banded 37", render_banded_odd},
+        {"banded default", render_banded_default},
+        {"region tiles", render_region_tiles},
+        {"into padded", render_into_padded},
+    };
+
+    // small cache keeps dropping sprites, caches are shared by all scenes like they can be by programs
+    uhm_sprite_cache* bigCache = uhm_sprite_cache_create(64 << 20);
+    uhm_sprite_cache* smallCache = uhm_sprite_cache_create(16 << 10);
+
+    int failures = 0;
+    for(size_t s = 0; s < scenes.size(); s++){
+        Scene& scene = scenes[s];
+        uhm_program* program = uhm_compile(scene.data.data(), (uint32_t)scene.data.size());
+        if(program == NULL){
+            printf("%s: couldn't compile\n", scene.name);
+            failures++;
+            continue;
+        }
+
+        // flat renders of first pass are kept to compare pattern walking renders of second pass against
+        std::vector<std::vector<unsigned char> > flat(sizeof(sizes) / sizeof(sizes[0]));
+        for(int pass = 0; pass < 2; pass++){
+            if(pass == 1) uhm_program_flatten(program, 0);
+            const char* mode = pass == 0 ? "flat" : "unflattened";
+
+            for(size_t d = 0; d < sizeof(sizes) / sizeof(sizes[0]); d++){
+                uint32_t width = sizes[d][0], height = sizes[d][1];
+                size_t bytes = (size_t)width * height * 4;
+                std::vector<unsigned char> expected(bytes), actual(bytes);
+                if(uhm_render(program, width, height, (char*)expected.data()) < 0){
+                    printf("%s %ux%u %s: render failed\n", scene.name, width, height, mode);
+                    failures++;
+                    continue;
+                }
+                if(pass == 0){
+                    flat[d] = expected;
+                    failures += check_cached(scene, program, width, height, expected, bigCache, "cached");
+                    failures += check_cached(scene, program, width, height, expected, smallCache, "cached small budget");
+                }
+                else if(flat[d] != expected){
+                    printf("%s %ux%u: unflattened render FAILED, differs from flat one\n", scene.name, width, height);
+                    failures++;
+                }
+
+                int checks = 0;
+                for(size_t r = 0; r < sizeof(renderers) / sizeof(renderers[0]); r++){
+                    Renderer& renderer = renderers[r];
+                    memset(actual.data(), 0, bytes);
+                    if(renderer.render(program, width, height, (char*)actual.data()) < 0){
+                        printf("%s %ux%u %s: %s failed\n", scene.name, width, height, mode, renderer.name);
+                        failures++;
+                        continue;
+                    }
+
+                    size_t badPixels = 0, firstBad = 0;
+                    for(size_t i = 0; i < bytes; i += 4){
+                        if(memcmp(&expected[i], &actual[i], 4) != 0){
+                            if(badPixels == 0) firstBad = i / 4;
+                            badPixels++;
+                        }
+                    }
+
+                    if(badPixels > 0){
+                        printf("%s %ux%u %s: %s FAILED, %zu pixels differ, first at (%zu, %zu)\n",
+                            scene.name, width, height, mode, renderer.name, badPixels, firstBad % width, firstBad / width);
+                        failures++;
+                    }else{
+                        checks++;
+                    }
+                }
+                printf("%s %ux%u %s: %d of %zu renderers match\n", scene.name, width, height, mode, checks, sizeof(renderers) / sizeof(renderers[0]));
+            }
+        }
+        uhm_program_free(program);
+    }
+    uhm_sprite_cache_destroy(bigCache);
+    uhm_sprite_cache_destroy(smallCache);
+
+    failures += check_random_grids(300);
+
+    if(failures > 0){
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
@@ -23,6 +23,113 @@
 */
 char* uhm_encode(char* data, uint32_t size, uint32_t width, uint32_t height);
 
+/*
+    Same as uhm_encode but draws into caller's memory, row n of image starts at out + n*strideBytes
+    strideBytes has to be multiple of 4 and at least width*4, bytes between rows are left alone, returns <0 on bad data
+*/
+int uhm_encode_into(char* data, uint32_t size, char* out, uint32_t width, uint32_t height, size_t strideBytes);
+
+/*
+    Same as uhm_encode but splits image into tiles that get rendered by threadCount threads (0 picks number of cpus)
+    every tile replays shapes touching it in instruction order so output is identical to uhm_encode
+*/
+char* uhm_encode_parallel(char* data, uint32_t size, uint32_t width, uint32_t height, uint32_t threadCount);
+
+/*
+    Holds parser and pattern state so uhm_encode can run on many threads at once, one context per thread
+    contexts can be reused for more files, patterns are forgotten at start of every file
+*/
+typedef struct uhm_context uhm_context;
+
+uhm_context* uhm_context_create(void);
+void uhm_context_destroy(uhm_context* context);
+
+/*
+    Parsed instructions live in few big blocks that get reused for next file, alloc and free are called only handful of times per file
+    alloc returns NULL when out of memory, zeroed allocator means UHM_MALLOC and UHM_FREE
+    set allocator before context parses anything
+*/
+typedef struct {
+    void* (*alloc)(void* user, size_t size);
+    void (*free)(void* user, void* ptr);
+    void* user;
+} uhm_allocator;
+
+void uhm_context_set_allocator(uhm_context* context, uhm_allocator allocator);
+char* uhm_context_encode(uhm_context* context, char* data, uint32_t size, uint32_t width, uint32_t height);
+int uhm_context_encode_into(uhm_context* context, char* data, uint32_t size, char* out, uint32_t width, uint32_t height, size_t strideBytes);
+
+/*
+    Parsed and validated file that can be rendered many times at any size, also from many threads at once
+    uhm_compile returns NULL on bad data, out passed to renders has to hold width*height*4 bytes
+    uhm_render_into takes row stride like uhm_encode_into, uhm_render_parallel splits image into tiles like uhm_encode_parallel
+*/
+typedef struct uhm_program uhm_program;
+
+uhm_program* uhm_compile(char* data, uint32_t size);
+uhm_program* uhm_compile_with_allocator(char* data, uint32_t size, uhm_allocator allocator);
+void uhm_program_free(uhm_program* program);
+uint32_t uhm_program_background_color(const uhm_program* program);
+int uhm_render(const uhm_program* program, uint32_t width, uint32_t height, char* out);
+int uhm_render_into(const uhm_program* program, uint32_t width, uint32_t height, char* out, size_t strideBytes);
+int uhm_render_parallel(const uhm_program* program, uint32_t width, uint32_t height, char* out, uint32_t threadCount);
+
+/*
+    uhm_compile also expands patterns and tiled patterns into flat list of up to UHM_MAX_INSTANCES shapes with their final placement,
+    renders without sprite cache draw, cull and bin that list instead of walking patterns every time
+    uhm_program_flatten redoes it with other limit, both it and uhm_program_instance_count give number of shapes
+    or -1 when there were more than limit and program draws through its patterns, don't flatten program while it's being rendered
+*/
+int64_t uhm_program_flatten(uhm_program* program, size_t maxInstances);
+int64_t uhm_program_instance_count(const uhm_program* program);
+
+/*
+    Parallel render for scenes of few big overlapping shapes, where every tile of uhm_render_parallel would replay the same long list
+    threads take whole instructions and write (instruction index, color) pairs into width*height*8 byte buffer with atomic max,
+    so pixel ends up with color of last instruction drawing it, same as uhm_render
+    instructions are taken from last one, parts of spans already covered by later instructions aren't colored at all
+*/
+int uhm_render_indexed(const uhm_program* program, uint32_t width, uint32_t height, char* out, uint32_t threadCount);
+
+/*
+    Same output as uhm_render but draws instructions from last to first and keeps bitmask of pixels that are already final
+    only pixels no later instruction covers get colored, so overdraw of layered scenes costs scanning bits instead of shading
+    stops early once whole canvas is covered, background only goes where nothing was drawn
+*/
+int uhm_render_occluded(const uhm_program* program, uint32_t width, uint32_t height, char* out);
+
+/*
+    Renders only pixels [x0, x0 + width) x [y0, y0 + height) of program drawn at virtualWidth x virtualHeight into out of width*height*4 bytes
+    pixels are same as those of whole render at virtual size, parts of region outside of virtual canvas get background
+    shapes and patterns missing region are skipped, so cost depends on region not on virtual size which can go up to 2^31 - 1
+*/
+int uhm_render_region(const uhm_program* program, uint32_t virtualWidth, uint32_t virtualHeight, uint32_t x0, uint32_t y0, uint32_t width, uint32_t height, char* out);
+
+/*
+    Cache of patterns drawn once into sprites, placements of same pattern at same rotation and scale become copies
+    placements snap to quarter of pixel (UHM_SPRITE_PHASES), so output is close to uhm_render but not same: pixels along edges
+    flip whole to other color and gradients are sampled at moved points, scene of 512x512 can have thousands of pixels off,
+    some by up to full channel range, examples/renderCheck.cpp bounds share of changed pixels
+    sprites over a quarter of budget aren't cached, least recently used ones get dropped when budget runs out
+    cache can be kept between renders and programs, but only used by one render at a time
+*/
+typedef struct uhm_sprite_cache uhm_sprite_cache;
+
+uhm_sprite_cache* uhm_sprite_cache_create(size_t budget);
+void uhm_sprite_cache_clear(uhm_sprite_cache* cache);
+void uhm_sprite_cache_destroy(uhm_sprite_cache* cache);
+int uhm_render_cached(const uhm_program* program, uint32_t width, uint32_t height, char* out, uhm_sprite_cache* cache);
+
+/*
+    Renders image bandHeight rows at a time (0 picks UHM_BAND_HEIGHT) into one reused band, so memory doesn't grow with image height
+    every band is handed to onBand as rowCount rows of width*4 bytes starting at firstRow, returning <0 from it stops rendering
+    instructions are binned by rows they touch up front so every band only draws ones reaching it, output is identical to uhm_render
+*/
+typedef int (*uhm_band_fn)(void* user, const char* pixels, uint32_t firstRow, uint32_t rowCount);
+
+int uhm_render_banded(const uhm_program* program, uint32_t width, uint32_t height, uint32_t bandHeight, uhm_band_fn onBand, void* user);
+int uhm_encode_banded(char* data, uint32_t size, uint32_t width, uint32_t height, uint32_t bandHeight, uhm_band_fn onBand, void* user);
+
 
 #ifndef UHM_MALLOC
 #define UHM_MALLOC(sz)        malloc(sz)
@@ -38,6 +145,27 @@ char* uhm_encode(char* data, uint32_t size, uint32_t width, uint32_t height);
 #define UHM_DA_INIT_CAP 256
 #endif
 
+/*
+    First capacity of instruction lists inside arena, pattern bodies are usually just few shapes
+*/
+#ifndef UHM_ARENA_LIST_INIT_CAP
+#define UHM_ARENA_LIST_INIT_CAP 4
+#endif
+
+/*
+    Smallest block arena asks allocator for
+*/
+#ifndef UHM_ARENA_MIN_BLOCK
+#define UHM_ARENA_MIN_BLOCK 4096
+#endif
+
+/*
+    Most arena reserves up front for file, huge or hostile sizes grow it block by block instead
+*/
+#ifndef UHM_ARENA_MAX_RESERVE
+#define UHM_ARENA_MAX_RESERVE ((size_t)16 << 20)
+#endif
+
 #ifndef __cplusplus
 #   ifndef decltype
 #      define decltype(v) void*
@@ -55,191 +183,225 @@ char* uhm_encode(char* data, uint32_t size, uint32_t width, uint32_t height);
         (da)->items[(da)->count++] = (item);                                                                    \
     } while (0)
 
-#ifndef UHM_NO_STDIO
-#include <stdio.h>
-
-#define UHM_PRINTF(x, ...) printf(x, ##__VA_ARGS__)
-#else
-#define UHM_PRINTF(x, ...)
+/*
+    Span kernels are built for every instruction set the compiler can target and picked at runtime by uhm_get_kernels
+    define UHM_NO_SIMD to build only plain scalar kernels
+*/
+#if !defined(UHM_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86))
+#   define UHM_X86
+#   include <immintrin.h>
+#   if defined(_MSC_VER) && !defined(__clang__)
+#       include <intrin.h>
+#       define UHM_TARGET(isa)
+#   else
+#       include <cpuid.h>
+#       define UHM_TARGET(isa) __attribute__((target(isa)))
+#   endif
 #endif
 
-#ifdef UHM_IMPLEMENTATION
-bool uhm_rotateModifierActive = false;
-float uhm_rotateModifierVal = 0.0f;
-bool uhm_scaleModifierActive = false;
-float uhm_scaleModifierVal = 1.0f;
+/*
+    Threads for uhm_encode_parallel, define UHM_NO_THREADS to render all tiles on calling thread
+*/
+#ifndef UHM_NO_THREADS
+#   if defined(_WIN32)
+#       ifndef WIN32_LEAN_AND_MEAN
+#           define WIN32_LEAN_AND_MEAN
+#       endif
+#       ifndef NOMINMAX
+#           define NOMINMAX
+#       endif
+#       include <windows.h>
+#   else
+#       include <pthread.h>
+#       include <unistd.h>
+#   endif
+#endif
 
-int uhm_peek(char* data, uint32_t size, uint32_t cursor, char* out){
-    if(cursor + 1 > size) return -1;
-    *out = *(data+cursor);
-    return 0;
-}
+/*
+    Side of square tiles uhm_encode_parallel splits image into
+*/
+#ifndef UHM_TILE_SIZE
+#define UHM_TILE_SIZE 64
+#endif
 
-int uhm_chop8(char* data,uint32_t size, uint32_t* cursor, uint8_t* out){
-    if(*cursor + 1 > size) return -1;
-    *out = (uint8_t)*(data+*cursor + 0);
-    *cursor += 1;
-    return 0;
-}
+/*
+    Rows per band uhm_render_banded uses when not told
+*/
+#ifndef UHM_BAND_HEIGHT
+#define UHM_BAND_HEIGHT 256
+#endif
 
-int uhm_chop16(char* data,uint32_t size, uint32_t* cursor, uint16_t* out){
-    if(*cursor + 2 > size) return -1;
-    uint16_t p1 = (uint16_t)((uint8_t)*(data+*cursor + 0));
-    uint16_t p2 = (uint16_t)((uint8_t)*(data+*cursor + 1));
-    *cursor += 2;
-    *out = (((uint16_t)p1) << 0 * 8) | (((uint16_t)p2) << 1 * 8);
-    return 0;
-}
+/*
+    Most shapes uhm_compile expands program into, bigger programs draw through their patterns
+*/
+#ifndef UHM_MAX_INSTANCES
+#define UHM_MAX_INSTANCES 65536
+#endif
 
-int uhm_chop32(char* data,uint32_t size, uint32_t* cursor, uint32_t* out){
-    if(*cursor + 4 > size) return -1;
-    uint32_t p1 = (uint32_t)((uint8_t)*(data+*cursor + 0));
-    uint32_t p2 = (uint32_t)((uint8_t)*(data+*cursor + 1));
-    uint32_t p3 = (uint32_t)((uint8_t)*(data+*cursor + 2));
-    uint32_t p4 = (uint32_t)((uint8_t)*(data+*cursor + 3));
-    *cursor += 4;
-    *out = (((uint32_t)p1) << 0 * 8) | (((uint32_t)p2) << 1 * 8) | (((uint32_t)p3) << 2 * 8) | (((uint32_t)p4) << 3 * 8);
-    return 0;
-}
+/*
+    Tiled cells and pattern placements flattening may walk per shape it's allowed to make, nesting deeper than this gives up earlier
+*/
+#ifndef UHM_FLATTEN_STEPS
+#define UHM_FLATTEN_STEPS 4
+#endif
 
-int uhm_chop64(char* data,uint32_t size, uint32_t* cursor, uint64_t* out){
-    if(*cursor + 8 > size) return -1;
+/*
+    How many shapes are measured for bounds of single instruction before giving up and treating it as covering whole canvas
+*/
+#ifndef UHM_MEASURE_BUDGET
+#define UHM_MEASURE_BUDGET 65536
+#endif
 
-    uint64_t p1 = (uint64_t)((uint8_t)*(data+*cursor + 0));
-    uint64_t p2 = (uint64_t)((uint8_t)*(data+*cursor + 1));
-    uint64_t p3 = (uint64_t)((uint8_t)*(data+*cursor + 2));
-    uint64_t p4 = (uint64_t)((uint8_t)*(data+*cursor + 3));
-    uint64_t p5 = (uint64_t)((uint8_t)*(data+*cursor + 3));
-    uint64_t p6 = (uint64_t)((uint8_t)*(data+*cursor + 3));
-    uint64_t p7 = (uint64_t)((uint8_t)*(data+*cursor + 3));
-    uint64_t p8 = (uint64_t)((uint8_t)*(data+*cursor + 3));
+/*
+    Sprite cache snaps pattern placements to 1/UHM_SPRITE_PHASES of pixel, so at most UHM_SPRITE_PHASES^2 sprites per pattern and transform
+*/
+#ifndef UHM_SPRITE_PHASES
+#define UHM_SPRITE_PHASES 4
+#endif
 
-    *cursor += 8;
+#ifndef UHM_SPRITE_BUCKETS
+#define UHM_SPRITE_BUCKETS 256
+#endif
 
-    *out = (((uint64_t)p1) << 0 * 8) | (((uint64_t)p2) << 1 * 8) | (((uint64_t)p3) << 2 * 8) | (((uint64_t)p4) << 3 * 8) |  (((uint64_t)p1) << 4 * 8) | (((uint64_t)p2) << 5 * 8) | (((uint64_t)p3) << 6 * 8) | (((uint64_t)p4) << 7 * 8);
-    return 0;
-}
+// sprites and snapped placements have to fit in +-UHM_SPRITE_FAR pixels
+#define UHM_SPRITE_FAR (1 << 24)
 
-int uhm_chopf32(char* data,uint32_t size, uint32_t* cursor, float* out){
-    if(*cursor + 4 > size) return -1;
+// circles are rasterized in int32 pixels, center and radius have to fit in +-UHM_CIRCLE_FAR so their sums do too
+#define UHM_CIRCLE_FAR (1 << 30)
 
-    uint32_t p1 = (uint32_t)((uint8_t)*(data+*cursor + 0));
-    uint32_t p2 = (uint32_t)((uint8_t)*(data+*cursor + 1));
-    uint32_t p3 = (uint32_t)((uint8_t)*(data+*cursor + 2));
-    uint32_t p4 = (uint32_t)((uint8_t)*(data+*cursor + 3));
+/*
+    Solid spans at least this many pixels long are written with non-temporal stores so huge fills don't flush the cache
+*/
+#ifndef UHM_STREAM_THRESHOLD
+#define UHM_STREAM_THRESHOLD 8192
+#endif
 
-    *cursor += 4;
-    uint32_t intermediate = (((uint32_t)p1) << 0 * 8) | (((uint32_t)p2) << 1 * 8) | (((uint32_t)p3) << 2 * 8) | (((uint32_t)p4) << 3 * 8);
-    *out = *((float*)&intermediate);
-    return 0;
-}
+#ifndef UHM_NO_STDIO
+#include <stdio.h>
 
-int uhm_chopf64(char* data,uint32_t size, uint32_t* cursor, double* out){
-    if(*cursor + 8 > size) return -1;
-    uint64_t p1 = (uint64_t)((uint8_t)*(data+*cursor + 0));
-    uint64_t p2 = (uint64_t)((uint8_t)*(data+*cursor + 1));
-    uint64_t p3 = (uint64_t)((uint8_t)*(data+*cursor + 2));
-    uint64_t p4 = (uint64_t)((uint8_t)*(data+*cursor + 3));
-    uint64_t p5 = (uint64_t)((uint8_t)*(data+*cursor + 3));
-    uint64_t p6 = (uint64_t)((uint8_t)*(data+*cursor + 3));
-    uint64_t p7 = (uint64_t)((uint8_t)*(data+*cursor + 3));
-    uint64_t p8 = (uint64_t)((uint8_t)*(data+*cursor + 3));
+#define UHM_PRINTF(x, ...) printf(x, ##__VA_ARGS__)
+#else
+// statement of its own so `if(...) UHM_PRINTF(...);` doesn't end up with empty body
+#define UHM_PRINTF(x, ...) do{}while(0)
+#endif
 
-    *cursor += 8;
+#ifdef UHM_IMPLEMENTATION
+#if defined(UHM_NO_THREADS)
+int32_t uhm_atomic_add(volatile int32_t* value, int32_t amount){
+    int32_t old = *value;
+    *value += amount;
+    return old;
+}
+#elif defined(_WIN32)
+int32_t uhm_atomic_add(volatile int32_t* value, int32_t amount){
+    return InterlockedExchangeAdd((volatile LONG*)value, amount);
+}
+#else
+int32_t uhm_atomic_add(volatile int32_t* value, int32_t amount){
+    return __atomic_fetch_add(value, amount, __ATOMIC_SEQ_CST);
+}
+#endif
 
-    uint32_t intermediate = (((uint64_t)p1) << 0 * 8) | (((uint64_t)p2) << 1 * 8) | (((uint64_t)p3) << 2 * 8) | (((uint64_t)p4) << 3 * 8) |  (((uint64_t)p1) << 4 * 8) | (((uint64_t)p2) << 5 * 8) | (((uint64_t)p3) << 6 * 8) | (((uint64_t)p4) << 7 * 8);
-    *out = *((double*)&intermediate);
-    return 0;
+/*
+    Acquire load, compare and swap and release store for state of uhm_once
+*/
+#if defined(UHM_NO_THREADS)
+int32_t uhm_atomic_load_acquire(volatile int32_t* value){
+    return *value;
+}
+bool uhm_atomic_cas32(volatile int32_t* value, int32_t expected, int32_t desired){
+    if(*value != expected) return false;
+    *value = desired;
+    return true;
+}
+void uhm_atomic_store_release(volatile int32_t* value, int32_t desired){
+    *value = desired;
+}
+#elif defined(_WIN32)
+int32_t uhm_atomic_load_acquire(volatile int32_t* value){
+    return InterlockedCompareExchange((volatile LONG*)value, 0, 0);
+}
+bool uhm_atomic_cas32(volatile int32_t* value, int32_t expected, int32_t desired){
+    return InterlockedCompareExchange((volatile LONG*)value, desired, expected) == expected;
+}
+void uhm_atomic_store_release(volatile int32_t* value, int32_t desired){
+    InterlockedExchange((volatile LONG*)value, desired);
+}
+#else
+int32_t uhm_atomic_load_acquire(volatile int32_t* value){
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+}
+bool uhm_atomic_cas32(volatile int32_t* value, int32_t expected, int32_t desired){
+    return __atomic_compare_exchange_n(value, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+void uhm_atomic_store_release(volatile int32_t* value, int32_t desired){
+    __atomic_store_n(value, desired, __ATOMIC_RELEASE);
 }
+#endif
 
-int uhm_expect(char* data, uint32_t size, uint32_t cursor, char expected){
-    char peeked;
-    int e;
-    if((e=uhm_peek(data, size, cursor,&peeked))<0) return e;
-    return peeked == expected;
+/*
+    Runs init exactly once however many threads get here first, *state goes 0 -> 1 while init runs and 1 -> 2 once it's done
+    threads that lose the race wait for 2, init is short so they just spin, after that it's one acquire load
+*/
+void uhm_once(volatile int32_t* state, void (*init)(void)){
+    if(uhm_atomic_load_acquire(state) == 2) return;
+    if(uhm_atomic_cas32(state, 0, 1)){
+        init();
+        uhm_atomic_store_release(state, 2);
+        return;
+    }
+    while(uhm_atomic_load_acquire(state) != 2){}
 }
 
-uint32_t uhm_lerpColors(uint32_t colorA, uint32_t colorB, double t){
-    uint8_t AX = (colorA >> 0*8);
-    uint8_t AY = (colorA >> 1*8);
-    uint8_t AZ = (colorA >> 2*8);
-    uint8_t AW = (colorA >> 3*8);
-
-    uint8_t BX = (colorB >> 0*8);
-    uint8_t BY = (colorB >> 1*8);
-    uint8_t BZ = (colorB >> 2*8);
-    uint8_t BW = (colorB >> 3*8);
-
-    uint8_t CX = (double)AX * (1.0 - t) + (double)BX * t;
-    uint8_t CY = (double)AY * (1.0 - t) + (double)BY * t;
-    uint8_t CZ = (double)AZ * (1.0 - t) + (double)BZ * t;
-    uint8_t CW = (double)AW * (1.0 - t) + (double)BW * t;
-
-    return (((uint32_t)CX) << 0*8) | (((uint32_t)CY) << 1*8) | (((uint32_t)CZ) << 2*8) | (((uint32_t)CW) << 3*8);
-}
-
-uint32_t uhm_linearGetColor(int32_t px, int32_t py, int32_t bbx, int32_t bby, uint32_t bbWidth, uint32_t bbHeight, float px1, float py1, float px2, float py2, uint32_t color1, uint32_t color2){
-    int32_t ax = py1*bbHeight + bby;
-    int32_t ay = px1*bbWidth + bbx;
-    int32_t bx = py2*bbHeight + bby;
-    int32_t by = px2*bbWidth + bbx;
-
-    //Projecting point onto line
-    int32_t directionVecX = bx - ax;
-    int32_t directionVecY = by - ay;
-    int32_t vecAPx = px - ax;
-    int32_t vecAPy = py - ay;
-    int32_t APdot = (px - ax) * (bx - ax) + (py - ay) * (by - ay);
-    int32_t ddDot = (bx - ax) * (bx - ax) + (by - ay) * (by - ay);
-    double projScalar = (double)APdot/ddDot;
-
-    double projX = ax + projScalar*(bx-ax);
-    double projY = ay + projScalar*(by-ay);
-
-    //finding interpolator
-    double vX = px - ax;
-    double vY = py - ay;
-    double vD = vX * directionVecX + vY * directionVecY;
-    double T = vD / (directionVecX*directionVecX + directionVecY*directionVecY);
-    if(vD == 0) T = 0;
-
-    //clamping result
-    if (T < 0) T = 0;
-    if (T > 1) T = 1;
-
-    return uhm_lerpColors(color1,color2, T);
-}
-
-uint32_t uhm_circularGetColor(
-    int32_t px, int32_t py, 
-    int32_t bbx, int32_t bby, 
-    uint32_t bbWidth, uint32_t bbHeight, 
-    float centerX, float centerY, 
-    float radius, 
-    uint32_t colorInner, uint32_t colorOuter) {
-    // Compute the center position of the circular gradient
-    int32_t cy = centerX * bbWidth + bbx;
-    int32_t cx = centerY * bbHeight + bby;
-
-    // Calculate the distance of the point (px, py) from the center (cx, cy)
-    double dx = px - cx;
-    double dy = py - cy;
-    double distance = sqrt(dx * dx + dy * dy);
-
-    // Normalize the distance to the range [0, 1] using the radius
-    double t = distance / (radius * sqrt(bbWidth * bbWidth + bbHeight * bbHeight));
-
-    // Clamp `t` to the range [0, 1]
-    if (t < 0) t = 0;
-    if (t > 1) t = 1;
-
-    // Interpolate the colors based on the normalized distance
-    return uhm_lerpColors(colorInner, colorOuter, t);
+/*
+    64 bit load and compare and swap for index buffer of uhm_render_indexed, no ordering is needed since threads are joined before it's read
+*/
+#if defined(UHM_NO_THREADS)
+uint64_t uhm_atomic_load64(volatile uint64_t* value){
+    return *value;
+}
+bool uhm_atomic_cas64(volatile uint64_t* value, uint64_t expected, uint64_t desired){
+    if(*value != expected) return false;
+    *value = desired;
+    return true;
+}
+#elif defined(_WIN32)
+uint64_t uhm_atomic_load64(volatile uint64_t* value){
+#if defined(_WIN64)
+    return *value;
+#else
+    return (uint64_t)InterlockedCompareExchange64((volatile LONG64*)value, 0, 0);
+#endif
 }
+bool uhm_atomic_cas64(volatile uint64_t* value, uint64_t expected, uint64_t desired){
+    return (uint64_t)InterlockedCompareExchange64((volatile LONG64*)value, (LONG64)desired, (LONG64)expected) == expected;
+}
+#else
+uint64_t uhm_atomic_load64(volatile uint64_t* value){
+    return __atomic_load_n(value, __ATOMIC_RELAXED);
+}
+bool uhm_atomic_cas64(volatile uint64_t* value, uint64_t expected, uint64_t desired){
+    return __atomic_compare_exchange_n(value, &expected, desired, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+#endif
 
-#define cx px1
-#define cy py1
-#define radius px2
+typedef struct uhm_instruction uhm_instruction;
+
+typedef struct {
+    uhm_instruction *items;
+    size_t           count;
+    size_t           capacity;
+} uhm_instructions;
+
+/*
+    Conservative reach of instruction drawn at (gx, gy) with scale s and any rotation
+    every pixel it writes is within (near + far*s) * max(width, height) pixels of canvas point (gx + x, gy + y), give or take rounding
+    doesn't hold for circles on non square canvas, their y is scaled by width
+*/
+typedef struct {
+    float x, y;
+    float near, far;
+} uhm_bounds;
 
 typedef struct {
     float x,y,width,height,px1,py1,px2,py2;
@@ -249,815 +411,3528 @@ typedef struct {
     float scale;
 } uhm_rectangle;
 
-int uhm_parse_rectangle(uhm_rectangle* rectangle, char* data, uint32_t size, uint32_t* cursor){
-    if(uhm_rotateModifierActive){
-        rectangle->rotation = uhm_rotateModifierVal;
-        uhm_rotateModifierActive = false;
+typedef struct {
+    float x,y,r,px1,py1,px2,py2;
+    uint8_t fillType;
+    uint32_t color,color2;
+    float rotation;
+    float scale;
+} uhm_circle;
+
+typedef struct {
+    float x,y,rw,rh,px1,py1,px2,py2;
+    uint8_t fillType;
+    uint32_t color,color2;
+    float rotation;
+    float scale;
+} uhm_ellipse;
+
+typedef struct{
+    float gx,gy;
+    float ox,oy;
+    uint16_t rows, cols;
+    uhm_instructions instructions;
+    float rotation;
+    float scale;
+    bool checked; // every cell can be drawn
+    bool hasCircle;
+    uhm_bounds cell; // around cell's point, set once checked
+} uhm_tiledPattern;
+
+typedef struct {
+    uint16_t patternID;
+    float x;
+    float y;
+    float rotation;
+    float scale;
+} uhm_place_pattern;
+
+/*
+    Instruction keeps its shape inline, opcode tells which member of union is set
+*/
+struct uhm_instruction{
+    uint8_t opcode;
+    bool skip_draw;
+    union {
+        uhm_rectangle rectangle;
+        uhm_circle circle;
+        uhm_ellipse ellipse;
+        uhm_tiledPattern tiledPattern;
+        uhm_place_pattern placePattern;
+    };
+};
+
+/*
+    Placement instruction is drawn with, its x and y get moved by (x, y), rotation added to and scale multiplied by
+    cosine and sine of -rotation are worked out once per nesting level, children and cells of that level reuse them
+*/
+typedef struct {
+    float x, y;
+    float rotation, scale;
+    float cosRotation, sinRotation;
+} uhm_transform;
+
+/*
+    Level nested in parent that adds rotation and scale of its own, trig is only redone when rotation changes
+*/
+uhm_transform uhm_nest_transform(const uhm_transform* parent, float x, float y, float rotation, float scale){
+    uhm_transform transform = *parent;
+    transform.x = x + parent->x;
+    transform.y = y + parent->y;
+    transform.rotation = rotation + parent->rotation;
+    transform.scale = scale * parent->scale;
+    if(rotation != 0){
+        transform.cosRotation = cosf(-transform.rotation);
+        transform.sinRotation = sinf(-transform.rotation);
     }
+    return transform;
+}
 
-    if(uhm_scaleModifierActive){
-        rectangle->scale = uhm_scaleModifierVal;
-        uhm_scaleModifierActive = false;
+/*
+    Same level moved to (x, y)
+*/
+uhm_transform uhm_transform_at(const uhm_transform* level, float x, float y){
+    uhm_transform transform = *level;
+    transform.x = x;
+    transform.y = y;
+    return transform;
+}
+
+const uhm_transform uhm_identity_transform = {0, 0, 0, 1, 1, 0};
+
+/*
+    Shapes of whole program with patterns and tiled patterns expanded, one array per field
+    shape i is its instruction drawn with transform made of x, y, rotation, scale, cosRotation and sinRotation at i
+    it stays within reach * max(width, height) pixels of canvas point (centerX, centerY), circles scale centerY by width like their y
+    order is place of shape in draw order, so arrays can be sorted by kind or bin and still be drawn right
+    while collecting steps counts tiled cells and pattern placements walked, bodies without shapes add steps but no shapes
+*/
+typedef struct {
+    size_t count, capacity;
+    size_t steps, stepBudget;
+    uhm_instruction** shape;
+    float* x;
+    float* y;
+    float* rotation;
+    float* scale;
+    float* cosRotation;
+    float* sinRotation;
+    float* centerX;
+    float* centerY;
+    float* reach;
+    uint32_t* order;
+    uint8_t* kind;
+} uhm_instances;
+
+typedef struct {
+    uint16_t patternID;
+    uhm_instructions instructions;
+    uhm_bounds bounds; // around placement point, set once checked
+    uint8_t checked; // 0 not yet, 1 being checked, 2 can be drawn
+    bool hasCircle; // circles scale y by canvas width, so on non square canvas whole pattern doesn't move by whole pixels
+} uhm_pattern;
+
+typedef struct {
+    uhm_pattern* items;
+    size_t       count;
+    size_t       capacity;
+} uhm_patterns;
+
+void* uhm_default_alloc(void* user, size_t size){
+    return UHM_MALLOC(size);
+}
+
+void uhm_default_free(void* user, void* ptr){
+    UHM_FREE(ptr);
+}
+
+typedef struct uhm_arena_block{
+    struct uhm_arena_block* next;
+    size_t capacity;
+    size_t used;
+} uhm_arena_block;
+
+#define UHM_ARENA_ALIGN(n) (((n) + 15) & ~(size_t)15)
+#define UHM_ARENA_BLOCK_DATA(block) ((char*)(block) + UHM_ARENA_ALIGN(sizeof(uhm_arena_block)))
+
+/*
+    Bump allocator, blocks after current one are left over from before last reset and get reused
+*/
+typedef struct {
+    uhm_allocator allocator;
+    uhm_arena_block* first;
+    uhm_arena_block* current;
+} uhm_arena;
+
+void* uhm_arena_alloc(uhm_arena* arena, size_t size){
+    size = UHM_ARENA_ALIGN(size);
+    uhm_arena_block* block = arena->current;
+    while(block != NULL && block->used + size > block->capacity && block->next != NULL){
+        block = block->next;
+        block->used = 0;
+    }
+
+    if(block == NULL || block->used + size > block->capacity){
+        if(arena->allocator.alloc == NULL){
+            arena->allocator.alloc = uhm_default_alloc;
+            arena->allocator.free = uhm_default_free;
+        }
+        size_t capacity = block != NULL ? block->capacity * 2 : UHM_ARENA_MIN_BLOCK;
+        if(capacity < size) capacity = size;
+        uhm_arena_block* fresh = (uhm_arena_block*)arena->allocator.alloc(arena->allocator.user, UHM_ARENA_ALIGN(sizeof(uhm_arena_block)) + capacity);
+        if(fresh == NULL) return NULL;
+        fresh->next = NULL;
+        fresh->capacity = capacity;
+        fresh->used = 0;
+        if(block != NULL) block->next = fresh;
+        else arena->first = fresh;
+        block = fresh;
+    }
+
+    arena->current = block;
+    void* out = UHM_ARENA_BLOCK_DATA(block) + block->used;
+    block->used += size;
+    return out;
+}
+
+/*
+    Grows last allocation in place when it's on top of arena, otherwise moves it
+*/
+void* uhm_arena_grow(uhm_arena* arena, void* ptr, size_t oldSize, size_t newSize){
+    uhm_arena_block* block = arena->current;
+    if(ptr != NULL && block != NULL && (char*)ptr + UHM_ARENA_ALIGN(oldSize) == UHM_ARENA_BLOCK_DATA(block) + block->used){
+        size_t start = (char*)ptr - UHM_ARENA_BLOCK_DATA(block);
+        if(start + UHM_ARENA_ALIGN(newSize) <= block->capacity){
+            block->used = start + UHM_ARENA_ALIGN(newSize);
+            return ptr;
+        }
+    }
+    void* out = uhm_arena_alloc(arena, newSize);
+    if(out != NULL && oldSize > 0) memcpy(out, ptr, oldSize);
+    return out;
+}
+
+void uhm_arena_reset(uhm_arena* arena){
+    arena->current = arena->first;
+    if(arena->first != NULL) arena->first->used = 0;
+}
+
+/*
+    Makes sure first block can hold at least size bytes so small files need single allocation
+*/
+void uhm_arena_reserve(uhm_arena* arena, size_t size){
+    if(arena->first != NULL) return;
+    if(size < UHM_ARENA_MIN_BLOCK) size = UHM_ARENA_MIN_BLOCK;
+    if(size > UHM_ARENA_MAX_RESERVE) size = UHM_ARENA_MAX_RESERVE;
+    if(uhm_arena_alloc(arena, size) != NULL) uhm_arena_reset(arena);
+}
+
+void uhm_arena_free(uhm_arena* arena){
+    uhm_arena_block* block = arena->first;
+    while(block != NULL){
+        uhm_arena_block* next = block->next;
+        arena->allocator.free(arena->allocator.user, block);
+        block = next;
+    }
+    arena->first = NULL;
+    arena->current = NULL;
+}
+
+/*
+    Doubles capacity of list living in arena, when allocator fails items come back unchanged and capacity stays same
+*/
+void* uhm_arena_grow_list(uhm_arena* arena, void* items, size_t* capacity, size_t itemSize){
+    size_t newCapacity = *capacity == 0 ? UHM_ARENA_LIST_INIT_CAP : *capacity * 2;
+    if(newCapacity > SIZE_MAX / itemSize) return items;
+    void* grown = uhm_arena_grow(arena, items, *capacity * itemSize, newCapacity * itemSize);
+    if(grown == NULL) return items;
+    *capacity = newCapacity;
+    return grown;
+}
+
+// evaluates to 0, or to -1 without touching list when it couldn't grow
+#define uhm_arena_append(arena, da, item)                                                                                     \
+    (((da)->count < (da)->capacity ||                                                                                         \
+      ((da)->items = (decltype((da)->items))uhm_arena_grow_list((arena), (da)->items, &(da)->capacity, sizeof(*(da)->items)), \
+       (da)->count < (da)->capacity))                                                                                         \
+        ? ((da)->items[(da)->count++] = (item), 0) : -1)
+
+/*
+    Everything parser and draw functions share, modifiers waiting for next instruction and defined patterns
+    zeroed struct is ready to use, all instructions and pattern lists are allocated from arena
+*/
+struct uhm_context{
+    bool rotateModifierActive;
+    float rotateModifierVal;
+    bool scaleModifierActive;
+    float scaleModifierVal;
+    uhm_patterns patterns;
+    uint32_t* patternSlots; // patternID -> index + 1 into patterns, 0 when not defined, allocated with first pattern
+    uhm_arena arena;
+    int32_t generation; // different for every parsed file so sprite cache never mixes up patterns of two files
+};
+
+volatile int32_t uhm_generationCounter = 0;
+
+uhm_pattern* uhm_find_pattern(uhm_context* context, uint16_t patternID){
+    if(context->patternSlots == NULL || context->patternSlots[patternID] == 0) return NULL;
+    return &context->patterns.items[context->patternSlots[patternID] - 1];
+}
+
+int uhm_peek(char* data, uint32_t size, uint32_t cursor, char* out){
+    if(cursor + 1 > size) return -1;
+    *out = *(data+cursor);
+    return 0;
+}
+
+int uhm_chop8(char* data,uint32_t size, uint32_t* cursor, uint8_t* out){
+    if(*cursor + 1 > size) return -1;
+    *out = (uint8_t)*(data+*cursor + 0);
+    *cursor += 1;
+    return 0;
+}
+
+int uhm_chop16(char* data,uint32_t size, uint32_t* cursor, uint16_t* out){
+    if(*cursor + 2 > size) return -1;
+    uint16_t p1 = (uint16_t)((uint8_t)*(data+*cursor + 0));
+    uint16_t p2 = (uint16_t)((uint8_t)*(data+*cursor + 1));
+    *cursor += 2;
+    *out = (((uint16_t)p1) << 0 * 8) | (((uint16_t)p2) << 1 * 8);
+    return 0;
+}
+
+int uhm_chop32(char* data,uint32_t size, uint32_t* cursor, uint32_t* out){
+    if(*cursor + 4 > size) return -1;
+    uint32_t p1 = (uint32_t)((uint8_t)*(data+*cursor + 0));
+    uint32_t p2 = (uint32_t)((uint8_t)*(data+*cursor + 1));
+    uint32_t p3 = (uint32_t)((uint8_t)*(data+*cursor + 2));
+    uint32_t p4 = (uint32_t)((uint8_t)*(data+*cursor + 3));
+    *cursor += 4;
+    *out = (((uint32_t)p1) << 0 * 8) | (((uint32_t)p2) << 1 * 8) | (((uint32_t)p3) << 2 * 8) | (((uint32_t)p4) << 3 * 8);
+    return 0;
+}
+
+int uhm_chop64(char* data,uint32_t size, uint32_t* cursor, uint64_t* out){
+    if(*cursor + 8 > size) return -1;
+
+    uint64_t p1 = (uint64_t)((uint8_t)*(data+*cursor + 0));
+    uint64_t p2 = (uint64_t)((uint8_t)*(data+*cursor + 1));
+    uint64_t p3 = (uint64_t)((uint8_t)*(data+*cursor + 2));
+    uint64_t p4 = (uint64_t)((uint8_t)*(data+*cursor + 3));
+    uint64_t p5 = (uint64_t)((uint8_t)*(data+*cursor + 3));
+    uint64_t p6 = (uint64_t)((uint8_t)*(data+*cursor + 3));
+    uint64_t p7 = (uint64_t)((uint8_t)*(data+*cursor + 3));
+    uint64_t p8 = (uint64_t)((uint8_t)*(data+*cursor + 3));
+
+    *cursor += 8;
+
+    *out = (((uint64_t)p1) << 0 * 8) | (((uint64_t)p2) << 1 * 8) | (((uint64_t)p3) << 2 * 8) | (((uint64_t)p4) << 3 * 8) |  (((uint64_t)p1) << 4 * 8) | (((uint64_t)p2) << 5 * 8) | (((uint64_t)p3) << 6 * 8) | (((uint64_t)p4) << 7 * 8);
+    return 0;
+}
+
+int uhm_chopf32(char* data,uint32_t size, uint32_t* cursor, float* out){
+    if(*cursor + 4 > size) return -1;
+
+    uint32_t p1 = (uint32_t)((uint8_t)*(data+*cursor + 0));
+    uint32_t p2 = (uint32_t)((uint8_t)*(data+*cursor + 1));
+    uint32_t p3 = (uint32_t)((uint8_t)*(data+*cursor + 2));
+    uint32_t p4 = (uint32_t)((uint8_t)*(data+*cursor + 3));
+
+    *cursor += 4;
+    uint32_t intermediate = (((uint32_t)p1) << 0 * 8) | (((uint32_t)p2) << 1 * 8) | (((uint32_t)p3) << 2 * 8) | (((uint32_t)p4) << 3 * 8);
+    *out = *((float*)&intermediate);
+    return 0;
+}
+
+int uhm_chopf64(char* data,uint32_t size, uint32_t* cursor, double* out){
+    if(*cursor + 8 > size) return -1;
+    uint64_t p1 = (uint64_t)((uint8_t)*(data+*cursor + 0));
+    uint64_t p2 = (uint64_t)((uint8_t)*(data+*cursor + 1));
+    uint64_t p3 = (uint64_t)((uint8_t)*(data+*cursor + 2));
+    uint64_t p4 = (uint64_t)((uint8_t)*(data+*cursor + 3));
+    uint64_t p5 = (uint64_t)((uint8_t)*(data+*cursor + 3));
+    uint64_t p6 = (uint64_t)((uint8_t)*(data+*cursor + 3));
+    uint64_t p7 = (uint64_t)((uint8_t)*(data+*cursor + 3));
+    uint64_t p8 = (uint64_t)((uint8_t)*(data+*cursor + 3));
+
+    *cursor += 8;
+
+    uint32_t intermediate = (((uint64_t)p1) << 0 * 8) | (((uint64_t)p2) << 1 * 8) | (((uint64_t)p3) << 2 * 8) | (((uint64_t)p4) << 3 * 8) |  (((uint64_t)p1) << 4 * 8) | (((uint64_t)p2) << 5 * 8) | (((uint64_t)p3) << 6 * 8) | (((uint64_t)p4) << 7 * 8);
+    *out = *((double*)&intermediate);
+    return 0;
+}
+
+int uhm_expect(char* data, uint32_t size, uint32_t cursor, char expected){
+    char peeked;
+    int e;
+    if((e=uhm_peek(data, size, cursor,&peeked))<0) return e;
+    return peeked == expected;
+}
+
+/*
+    Lerps two colors with t quantized to 8 bits (0 - 256), two channels at a time in 16 bit lanes of 32 bit integer
+    each lane holds at most 255*256 so channels never carry into each other
+*/
+uint32_t uhm_lerpColorsFixed(uint32_t colorA, uint32_t colorB, uint32_t t8){
+    uint32_t inv = 256 - t8;
+    uint32_t rb = ((colorA & 0x00FF00FF) * inv + (colorB & 0x00FF00FF) * t8) >> 8;
+    uint32_t ga = ((colorA >> 8) & 0x00FF00FF) * inv + ((colorB >> 8) & 0x00FF00FF) * t8;
+    return (rb & 0x00FF00FF) | (ga & 0xFF00FF00);
+}
+
+/*
+    Exact result would be floor(A + (B - A)*t) for every channel, quantizing t moves it by at most 255/512 < 1
+    so every channel is guaranteed to be within 1 from lerp done in double precision
+*/
+uint32_t uhm_lerpColors(uint32_t colorA, uint32_t colorB, double t){
+    return uhm_lerpColorsFixed(colorA, colorB, (uint32_t)(t * 256.0 + 0.5));
+}
+
+/*
+    Float pixel coordinate converted to int32, converting values out of range is undefined so they are clamped to +-INT32_MAX first and NaN becomes 0
+*/
+int32_t uhm_pixel(double v){
+    if(v >= INT32_MAX) return INT32_MAX;
+    if(v <= -INT32_MAX) return -INT32_MAX;
+    return v == v ? (int32_t)v : 0;
+}
+
+/*
+    Clips [lo, hi] pixel range onto [0, limit) and outputs it as half open [*out0, *out1)
+    returns false when nothing is left after clipping
+*/
+bool uhm_clip_range(float lo, float hi, int32_t min, int32_t max, int32_t* out0, int32_t* out1){
+    // written so that NaN bounds are rejected as well
+    if(!(lo < (float)max) || !(hi >= (float)min)) return false;
+    *out0 = lo > (float)min ? (int32_t)floorf(lo) : min;
+    *out1 = hi < (float)max - 1.0f ? (int32_t)ceilf(hi) + 1 : max;
+    return *out0 < *out1;
+}
+
+/*
+    Half open pixel rectangle [x0, x1) x [y0, y1)
+*/
+typedef struct {
+    int32_t x0, y0, x1, y1;
+} uhm_box;
+
+typedef struct {
+    uhm_box* items;
+    size_t   count;
+    size_t   capacity;
+} uhm_boxes;
+
+typedef struct uhm_probe uhm_probe;
+
+/*
+    Everything shapes draw ends up in target, width and height are size of canvas normalized coordinates map onto
+    only pixels inside of clip get written, pixel (row, col) is at data[(row - originY) * stride + col - originX]
+    clip can reach outside of canvas for offscreen targets like sprites, mask if set gets 1 for every written pixel
+    with indexBuffer set spans are colored in scratch and go to indexBuffer tagged with index + 1 instead of to data
+    with covered set only pixels whose bit is clear get written and written runs are added to pending (run's y0 is its row)
+    with instances set shapes aren't drawn but added to instances with transform they'd be drawn with, nothing gets culled
+    with probe set shapes aren't drawn either, only what they'd be rasterized with gets recorded or compared
+    when measuring nothing gets written, shapes only grow bounds by their screen space box
+*/
+typedef struct {
+    char* data;
+    uint32_t width, height;
+    uhm_box clip;
+    int32_t originX, originY;
+    size_t stride;
+    uint8_t* mask;
+    uhm_sprite_cache* sprites;
+    volatile uint64_t* indexBuffer;
+    uint32_t* scratch;
+    uint32_t index;
+    const uint64_t* covered;
+    size_t coveredWords;
+    uhm_boxes* pending;
+    uhm_instances* instances;
+    uhm_probe* probe;
+
+    bool measure;
+    uhm_box bounds;
+    int32_t measureBudget;
+} uhm_target;
+
+uhm_target uhm_make_target(char* data, uint32_t width, uint32_t height){
+    uhm_target target = {0};
+    target.data = data;
+    target.width = width;
+    target.height = height;
+    target.clip.x1 = width;
+    target.clip.y1 = height;
+    target.stride = width;
+    return target;
+}
+
+/*
+    Target for caller's memory with rows strideBytes apart, false when stride can't hold a row of whole pixels
+*/
+bool uhm_make_strided_target(char* data, uint32_t width, uint32_t height, size_t strideBytes, uhm_target* target){
+    if(strideBytes % 4 != 0 || strideBytes < (size_t)width * 4){
+        UHM_PRINTF("stride of %zu bytes doesn't fit rows of %u pixels\n", strideBytes, width);
+        return false;
+    }
+    *target = uhm_make_target(data, width, height);
+    target->stride = strideBytes / 4;
+    return true;
+}
+
+/*
+    Turns target into one that only measures, bounds start empty
+*/
+void uhm_target_start_measure(uhm_target* target){
+    target->measure = true;
+    target->bounds.x0 = target->bounds.y0 = INT32_MAX;
+    target->bounds.x1 = target->bounds.y1 = INT32_MIN;
+    target->measureBudget = UHM_MEASURE_BUDGET;
+}
+
+/*
+    Clips shape's screen space box [left, right] x [top, bottom] to target's clip into *box
+    when measuring the box is only added to bounds, false means there is nothing to draw
+*/
+bool uhm_target_clip(uhm_target* target, float left, float top, float right, float bottom, uhm_box* box){
+    if(!uhm_clip_range(left, right, target->clip.x0, target->clip.x1, &box->x0, &box->x1)) return false;
+    if(!uhm_clip_range(top, bottom, target->clip.y0, target->clip.y1, &box->y0, &box->y1)) return false;
+
+    if(target->measure){
+        if(box->x0 < target->bounds.x0) target->bounds.x0 = box->x0;
+        if(box->y0 < target->bounds.y0) target->bounds.y0 = box->y0;
+        if(box->x1 > target->bounds.x1) target->bounds.x1 = box->x1;
+        if(box->y1 > target->bounds.y1) target->bounds.y1 = box->y1;
+        target->measureBudget--;
+        return false;
+    }
+    return true;
+}
+
+/*
+    True when nothing within reach pixels of (centerX, centerY) is inside target's clip
+    some slack is added for rounding of shapes and of coordinates, NaNs never miss
+*/
+bool uhm_target_misses(const uhm_target* target, double centerX, double centerY, double reach){
+    reach += 2 + 1e-5 * (fabs(centerX) + fabs(centerY) + reach);
+    return
+        centerX + reach < target->clip.x0 || centerX - reach >= target->clip.x1 ||
+        centerY + reach < target->clip.y0 || centerY - reach >= target->clip.y1;
+}
+
+/*
+    Pixels within reach of center that are inside of target's clip, with same slack as uhm_target_misses
+*/
+uhm_box uhm_target_reach_box(const uhm_target* target, double centerX, double centerY, double reach){
+    reach += 2 + 1e-5 * (fabs(centerX) + fabs(centerY) + reach);
+    double x0 = floor(centerX - reach), x1 = floor(centerX + reach) + 1;
+    double y0 = floor(centerY - reach), y1 = floor(centerY + reach) + 1;
+    uhm_box box;
+    // ends are clamped into clip on both sides before converting, far away ones aren't representable
+    box.x0 = x0 > target->clip.x0 ? (x0 < target->clip.x1 ? (int32_t)x0 : target->clip.x1) : target->clip.x0;
+    box.y0 = y0 > target->clip.y0 ? (y0 < target->clip.y1 ? (int32_t)y0 : target->clip.y1) : target->clip.y0;
+    box.x1 = x1 < target->clip.x1 ? (x1 > target->clip.x0 ? (int32_t)x1 : target->clip.x0) : target->clip.x1;
+    box.y1 = y1 < target->clip.y1 ? (y1 > target->clip.y0 ? (int32_t)y1 : target->clip.y0) : target->clip.y1;
+    // clamped box of center far away can end up inside out or empty, that's empty like it should be
+    return box;
+}
+
+/*
+    Range [*first, *last) of k in [0, count) for which start + step*k can be within [lo, hi], one extra step on both ends covers rounding
+*/
+void uhm_step_range(double start, double step, double lo, double hi, int32_t count, int32_t* first, int32_t* last){
+    *first = 0;
+    *last = count;
+    if(step == 0){
+        if(start < lo || start > hi) *last = 0;
+        return;
+    }
+    double k0 = (lo - start) / step;
+    double k1 = (hi - start) / step;
+    if(k0 > k1){ double t = k0; k0 = k1; k1 = t; }
+    // NaN keeps whole range
+    if(k0 > 1) *first = k0 - 1 < count ? (int32_t)(k0 - 1) : count;
+    if(k1 < (double)count - 2) *last = k1 + 2 > 0 ? (int32_t)(k1 + 2) : 0;
+}
+
+/*
+    Describes how pixels of a shape get colored
+    for 'C' fill px1, py1 and px2 hold gradient's center x, center y and radius
+    bb* is the box gradient gets stretched over, rotation is angle gradient points are rotated by
+    fields after them are resolved once per draw by uhm_paint_setup so pixel loops only have to evaluate them
+*/
+typedef struct {
+    uint8_t fillType;
+    uint32_t color, color2;
+    float px1, py1, px2, py2;
+    float rotation;
+    int32_t bbx, bby;
+    uint32_t bbWidth, bbHeight;
+
+    int32_t originRow, originCol; // gradient start for 'L', center for 'C', pixels are subtracted from them in double since both can be near +-INT32_MAX
+    double stepRow, stepCol;      // change of t per pixel for 'L'
+    double invLength;             // 1 / length over which t goes from 0 to 1 for 'C'
+} uhm_paint;
+
+void uhm_paint_setup(uhm_paint* paint){
+    // solid fills don't need the rotation at all
+    if(paint->fillType == 'L'){
+        float cosTheta = cosf(paint->rotation);
+        float sinTheta = sinf(paint->rotation);
+        float rotatedPx1 = ((paint->px1 - 0.5) * cosTheta - (paint->py1 - 0.5) * sinTheta) + 0.5;
+        float rotatedPy1 = ((paint->px1 - 0.5) * sinTheta + (paint->py1 - 0.5) * cosTheta) + 0.5;
+        float rotatedPx2 = ((paint->px2 - 0.5) * cosTheta - (paint->py2 - 0.5) * sinTheta) + 0.5;
+        float rotatedPy2 = ((paint->px2 - 0.5) * sinTheta + (paint->py2 - 0.5) * cosTheta) + 0.5;
+
+        int32_t startRow = uhm_pixel(rotatedPy1*paint->bbHeight + paint->bby);
+        int32_t startCol = uhm_pixel(rotatedPx1*paint->bbWidth + paint->bbx);
+        int32_t endRow = uhm_pixel(rotatedPy2*paint->bbHeight + paint->bby);
+        int32_t endCol = uhm_pixel(rotatedPx2*paint->bbWidth + paint->bbx);
+
+        // t is projection of the pixel onto start->end divided by its squared length
+        double dirRow = (double)endRow - startRow;
+        double dirCol = (double)endCol - startCol;
+        double lengthSq = dirRow*dirRow + dirCol*dirCol;
+        paint->originRow = startRow;
+        paint->originCol = startCol;
+        paint->stepRow = lengthSq != 0 ? dirRow / lengthSq : 0;
+        paint->stepCol = lengthSq != 0 ? dirCol / lengthSq : 0;
+    }
+    else if(paint->fillType == 'C'){
+        float cosTheta = cosf(paint->rotation);
+        float sinTheta = sinf(paint->rotation);
+        float rotatedCx = ((paint->px1 - 0.5) * cosTheta - (paint->py1 - 0.5) * sinTheta) + 0.5;
+        float rotatedCy = ((paint->px1 - 0.5) * sinTheta + (paint->py1 - 0.5) * cosTheta) + 0.5;
+
+        paint->originRow = uhm_pixel(rotatedCy*paint->bbHeight + paint->bby);
+        paint->originCol = uhm_pixel(rotatedCx*paint->bbWidth + paint->bbx);
+        double diagonal = sqrt((double)paint->bbWidth*paint->bbWidth + (double)paint->bbHeight*paint->bbHeight);
+        paint->invLength = 1.0 / (paint->px2 * diagonal);
+    }
+}
+
+uint32_t uhm_paint_color(const uhm_paint* paint, int32_t row, int32_t col){
+    double t;
+    if(paint->fillType == 'L'){
+        t = ((double)row - paint->originRow) * paint->stepRow + ((double)col - paint->originCol) * paint->stepCol;
+    }
+    else if(paint->fillType == 'C'){
+        double dx = (double)row - paint->originRow;
+        double dy = (double)col - paint->originCol;
+        t = sqrt(dx*dx + dy*dy) * paint->invLength;
+    }
+    else return paint->color;
+
+    // written so that NaN ends up as 0
+    if(!(t > 0)) t = 0;
+    if(t > 1) t = 1;
+    return uhm_lerpColors(paint->color, paint->color2, t);
+}
+
+void uhm_fill_color_scalar(uint32_t* out, uint32_t color, size_t count){
+    for(size_t i = 0; i < count; i++) out[i] = color;
+}
+
+/*
+    Lerps count pixels with t given in 32.32 fixed point and advanced by step every pixel
+    t is rounded to 8 bits and clamped so small drift outside of [0, 1] is harmless
+*/
+void uhm_lerp_span_scalar(uint32_t colorA, uint32_t colorB, int64_t tFixed, int64_t stepFixed, uint32_t* out, int32_t count){
+    for(int32_t i = 0; i < count; i++){
+        int64_t t8 = (tFixed + (1 << 23)) >> 24;
+        if(t8 < 0) t8 = 0;
+        if(t8 > 256) t8 = 256;
+        out[i] = uhm_lerpColorsFixed(colorA, colorB, (uint32_t)t8);
+        tFixed += stepFixed;
+    }
+}
+
+/*
+    Radial gradient along the row, t is distance from gradient's center times inverse length
+*/
+void uhm_radial_span_scalar(const uhm_paint* paint, int32_t row, int32_t x0, int32_t x1, uint32_t* out){
+    double dx = (double)row - paint->originRow;
+    for(int32_t j = x0; j < x1; j++){
+        double dy = (double)j - paint->originCol;
+        double t = sqrt(dx*dx + dy*dy) * paint->invLength;
+        if(!(t > 0)) t = 0;
+        if(t > 1) t = 1;
+        out[j - x0] = uhm_lerpColors(paint->color, paint->color2, t);
+    }
+}
+
+/*
+    Bit tricks for coverage masks, written out so they don't depend on compiler intrinsics or cpu having popcnt
+*/
+int32_t uhm_popcount64(uint64_t x){
+    x = x - ((x >> 1) & 0x5555555555555555ull);
+    x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+    return (int32_t)((x * 0x0101010101010101ull) >> 56);
+}
+
+/*
+    First bit in [from, to) of bits that is set (or clear), to when there is none
+*/
+int32_t uhm_find_bit_scalar(const uint64_t* bits, int32_t from, int32_t to, bool set){
+    while(from < to){
+        uint64_t word = set ? bits[from >> 6] : ~bits[from >> 6];
+        word &= ~(uint64_t)0 << (from & 63);
+        if(word != 0){
+            int32_t found = (from & ~63) + uhm_popcount64((word & (~word + 1)) - 1);
+            return found < to ? found : to;
+        }
+        from = (from & ~63) + 64;
+    }
+    return to;
+}
+
+/*
+    Sets bits [from, to) and returns how many of them weren't set before
+*/
+int64_t uhm_set_bits_scalar(uint64_t* bits, int32_t from, int32_t to){
+    int64_t added = 0;
+    while(from < to){
+        int32_t wordEnd = (from & ~63) + 64 < to ? (from & ~63) + 64 : to;
+        uint64_t mask = (~(uint64_t)0 << (from & 63)) & (~(uint64_t)0 >> (63 - ((wordEnd - 1) & 63)));
+        added += uhm_popcount64(mask & ~bits[from >> 6]);
+        bits[from >> 6] |= mask;
+        from = wordEnd;
+    }
+    return added;
+}
+
+#if defined(UHM_X86)
+/*
+    Coverage mask kernels for cpus with popcnt and bmi (every one that has avx2), same results as the scalar ones
+*/
+UHM_TARGET("popcnt,bmi")
+int32_t uhm_popcount64_popcnt(uint64_t x){
+#   if defined(__x86_64__) || defined(_M_X64)
+    return (int32_t)_mm_popcnt_u64(x);
+#   else
+    return _mm_popcnt_u32((uint32_t)x) + _mm_popcnt_u32((uint32_t)(x >> 32));
+#   endif
+}
+
+UHM_TARGET("popcnt,bmi")
+int32_t uhm_find_bit_bmi(const uint64_t* bits, int32_t from, int32_t to, bool set){
+    while(from < to){
+        uint64_t word = set ? bits[from >> 6] : ~bits[from >> 6];
+        word &= ~(uint64_t)0 << (from & 63);
+        if(word != 0){
+#   if defined(__x86_64__) || defined(_M_X64)
+            int32_t found = (from & ~63) + (int32_t)_tzcnt_u64(word);
+#   else
+            int32_t found = (from & ~63) + ((uint32_t)word != 0 ? (int32_t)_tzcnt_u32((uint32_t)word) : 32 + (int32_t)_tzcnt_u32((uint32_t)(word >> 32)));
+#   endif
+            return found < to ? found : to;
+        }
+        from = (from & ~63) + 64;
+    }
+    return to;
+}
+
+UHM_TARGET("popcnt,bmi")
+int64_t uhm_set_bits_popcnt(uint64_t* bits, int32_t from, int32_t to){
+    int64_t added = 0;
+    while(from < to){
+        int32_t wordEnd = (from & ~63) + 64 < to ? (from & ~63) + 64 : to;
+        uint64_t mask = (~(uint64_t)0 << (from & 63)) & (~(uint64_t)0 >> (63 - ((wordEnd - 1) & 63)));
+        added += uhm_popcount64_popcnt(mask & ~bits[from >> 6]);
+        bits[from >> 6] |= mask;
+        from = wordEnd;
+    }
+    return added;
+}
+#endif
+
+#if defined(UHM_X86)
+UHM_TARGET("sse2")
+void uhm_fill_color_sse2(uint32_t* out, uint32_t color, size_t count){
+    size_t i = 0;
+    if(count >= 8){
+        __m128i v = _mm_set1_epi32((int)color);
+        for(; i < count && ((uintptr_t)(out + i) & 15); i++) out[i] = color;
+        if(count - i >= UHM_STREAM_THRESHOLD){
+            for(; i + 4 <= count; i += 4) _mm_stream_si128((__m128i*)(out + i), v);
+            _mm_sfence();
+        }else{
+            for(; i + 4 <= count; i += 4) _mm_store_si128((__m128i*)(out + i), v);
+        }
+    }
+    for(; i < count; i++) out[i] = color;
+}
+
+UHM_TARGET("avx2")
+void uhm_fill_color_avx2(uint32_t* out, uint32_t color, size_t count){
+    size_t i = 0;
+    if(count >= 16){
+        __m256i v = _mm256_set1_epi32((int)color);
+        for(; i < count && ((uintptr_t)(out + i) & 31); i++) out[i] = color;
+        if(count - i >= UHM_STREAM_THRESHOLD){
+            for(; i + 8 <= count; i += 8) _mm256_stream_si256((__m256i*)(out + i), v);
+            _mm_sfence();
+        }else{
+            for(; i + 8 <= count; i += 8) _mm256_store_si256((__m256i*)(out + i), v);
+        }
+    }
+    for(; i < count; i++) out[i] = color;
+}
+
+UHM_TARGET("avx512f")
+void uhm_fill_color_avx512(uint32_t* out, uint32_t color, size_t count){
+    size_t i = 0;
+    if(count >= 32){
+        __m512i v = _mm512_set1_epi32((int)color);
+        for(; i < count && ((uintptr_t)(out + i) & 63); i++) out[i] = color;
+        if(count - i >= UHM_STREAM_THRESHOLD){
+            for(; i + 16 <= count; i += 16) _mm512_stream_si512((__m512i*)(out + i), v);
+            _mm_sfence();
+        }else{
+            for(; i + 16 <= count; i += 16) _mm512_store_si512((__m512i*)(out + i), v);
+        }
+    }
+    for(; i < count; i++) out[i] = color;
+}
+
+/*
+    uhm_lerpColorsFixed for 8 pixels at once, t8 holds quantized t of every pixel in its 32 bit lane
+*/
+UHM_TARGET("avx2")
+__m256i uhm_lerpColorsFixed_avx2(__m256i colorA, __m256i colorB, __m256i t8){
+    __m256i mask = _mm256_set1_epi32(0x00FF00FF);
+    __m256i t = _mm256_or_si256(t8, _mm256_slli_epi32(t8, 16));
+    __m256i inv = _mm256_sub_epi16(_mm256_set1_epi16(256), t);
+    __m256i rb = _mm256_add_epi16(
+        _mm256_mullo_epi16(_mm256_and_si256(colorA, mask), inv),
+        _mm256_mullo_epi16(_mm256_and_si256(colorB, mask), t)
+    );
+    __m256i ga = _mm256_add_epi16(
+        _mm256_mullo_epi16(_mm256_and_si256(_mm256_srli_epi32(colorA, 8), mask), inv),
+        _mm256_mullo_epi16(_mm256_and_si256(_mm256_srli_epi32(colorB, 8), mask), t)
+    );
+    return _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(rb, 8), mask), _mm256_andnot_si256(mask, ga));
+}
+
+/*
+    Same as uhm_lerp_span_scalar and bit exact with it, t of 8 pixels is kept in two registers of 64 bit lanes
+    biased by 2^40 so logical shift also rounds slightly negative t the same way as arithmetic one
+*/
+UHM_TARGET("avx2")
+void uhm_lerp_span_avx2(uint32_t colorA, uint32_t colorB, int64_t tFixed, int64_t stepFixed, uint32_t* out, int32_t count){
+    int32_t i = 0;
+    if(count >= 8){
+        __m256i a = _mm256_set1_epi32((int)colorA);
+        __m256i b = _mm256_set1_epi32((int)colorB);
+        int64_t t0 = tFixed + ((int64_t)1 << 23) + ((int64_t)1 << 40);
+        __m256i tLow = _mm256_setr_epi64x(t0, t0 + stepFixed, t0 + 2*stepFixed, t0 + 3*stepFixed);
+        __m256i tHigh = _mm256_add_epi64(tLow, _mm256_set1_epi64x(4*stepFixed));
+        __m256i advance = _mm256_set1_epi64x(8*stepFixed);
+        __m256i lowLanes = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+        __m256i bias = _mm256_set1_epi32(1 << 16);
+        __m256i zero = _mm256_setzero_si256();
+        __m256i one = _mm256_set1_epi32(256);
+        for(; i + 8 <= count; i += 8){
+            __m256i low = _mm256_permutevar8x32_epi32(_mm256_srli_epi64(tLow, 24), lowLanes);
+            __m256i high = _mm256_permutevar8x32_epi32(_mm256_srli_epi64(tHigh, 24), lowLanes);
+            __m256i t8 = _mm256_sub_epi32(_mm256_blend_epi32(low, high, 0xF0), bias);
+            t8 = _mm256_min_epi32(_mm256_max_epi32(t8, zero), one);
+            _mm256_storeu_si256((__m256i*)(out + i), uhm_lerpColorsFixed_avx2(a, b, t8));
+            tLow = _mm256_add_epi64(tLow, advance);
+            tHigh = _mm256_add_epi64(tHigh, advance);
+        }
+    }
+    uhm_lerp_span_scalar(colorA, colorB, tFixed + i*stepFixed, stepFixed, out + i, count - i);
+}
+
+/*
+    Radial gradient for 8 pixels at once, distance is computed in single precision
+    so t can round to neighbouring 8 bit step and channels can differ by 1 from uhm_radial_span_scalar
+    last partial group goes through the vector path as well so pixel's color doesn't depend on where its span starts
+*/
+UHM_TARGET("avx2")
+void uhm_radial_span_avx2(const uhm_paint* paint, int32_t row, int32_t x0, int32_t x1, uint32_t* out){
+    int32_t count = x1 - x0;
+    __m256i a = _mm256_set1_epi32((int)paint->color);
+    __m256i b = _mm256_set1_epi32((int)paint->color2);
+    float dx = (float)((double)row - paint->originRow);
+    __m256 dxSq = _mm256_set1_ps(dx*dx);
+    __m256 dy = _mm256_add_ps(_mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_ps((float)((double)x0 - paint->originCol)));
+    __m256 advance = _mm256_set1_ps(8.0f);
+    __m256 invLength = _mm256_set1_ps((float)paint->invLength);
+    __m256 zero = _mm256_setzero_ps();
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 steps = _mm256_set1_ps(256.0f);
+    __m256 half = _mm256_set1_ps(0.5f);
+    for(int32_t i = 0; i < count; i += 8){
+        __m256 t = _mm256_mul_ps(_mm256_sqrt_ps(_mm256_add_ps(dxSq, _mm256_mul_ps(dy, dy))), invLength);
+        // max picks zero for NaN t
+        t = _mm256_min_ps(_mm256_max_ps(t, zero), one);
+        __m256i t8 = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(t, steps), half));
+        __m256i colors = uhm_lerpColorsFixed_avx2(a, b, t8);
+        if(i + 8 <= count){
+            _mm256_storeu_si256((__m256i*)(out + i), colors);
+        }else{
+            uint32_t rest[8];
+            _mm256_storeu_si256((__m256i*)rest, colors);
+            memcpy(out + i, rest, (count - i) * sizeof(uint32_t));
+        }
+        dy = _mm256_add_ps(dy, advance);
+    }
+}
+#endif
+
+/*
+    Kernel table, one per instruction set
+*/
+typedef struct {
+    const char* isa;
+    void (*fillColor)(uint32_t* out, uint32_t color, size_t count);
+    void (*lerpSpan)(uint32_t colorA, uint32_t colorB, int64_t tFixed, int64_t stepFixed, uint32_t* out, int32_t count);
+    void (*radialSpan)(const uhm_paint* paint, int32_t row, int32_t x0, int32_t x1, uint32_t* out);
+    int32_t (*findBit)(const uint64_t* bits, int32_t from, int32_t to, bool set);
+    int64_t (*setBits)(uint64_t* bits, int32_t from, int32_t to);
+} uhm_kernels;
+
+enum {
+    UHM_ISA_SCALAR,
+    UHM_ISA_SSE2,
+    UHM_ISA_AVX2,
+    UHM_ISA_AVX512,
+};
+
+/*
+    Gradients have no sse2 kernels and avx512 ones wouldn't gain over avx2 for spans this short, so those rows share kernels
+    sse2 cpus don't all have popcnt, so coverage kernels need avx2 row
+*/
+const uhm_kernels uhm_kernel_tables[] = {
+    {"scalar", uhm_fill_color_scalar, uhm_lerp_span_scalar, uhm_radial_span_scalar, uhm_find_bit_scalar, uhm_set_bits_scalar},
+#if defined(UHM_X86)
+    {"sse2",   uhm_fill_color_sse2,   uhm_lerp_span_scalar, uhm_radial_span_scalar, uhm_find_bit_scalar, uhm_set_bits_scalar},
+    {"avx2",   uhm_fill_color_avx2,   uhm_lerp_span_avx2,   uhm_radial_span_avx2,   uhm_find_bit_bmi,    uhm_set_bits_popcnt},
+    {"avx512", uhm_fill_color_avx512, uhm_lerp_span_avx2,   uhm_radial_span_avx2,   uhm_find_bit_bmi,    uhm_set_bits_popcnt},
+#endif
+};
+
+/*
+    Returns best instruction set this cpu and os support
+*/
+int uhm_detect_isa(void){
+#if defined(UHM_X86)
+    unsigned int regs1[4] = {0}, regs7[4] = {0};
+    unsigned long long xcr0 = 0;
+#   if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    for(int i = 0; i < 4; i++) regs1[i] = info[i];
+    if(maxLeaf >= 7){
+        __cpuidex(info, 7, 0);
+        for(int i = 0; i < 4; i++) regs7[i] = info[i];
+    }
+    if(regs1[2] & (1u << 27)) xcr0 = _xgetbv(0);
+#   else
+    unsigned int maxLeaf = __get_cpuid_max(0, NULL);
+    __get_cpuid(1, &regs1[0], &regs1[1], &regs1[2], &regs1[3]);
+    if(maxLeaf >= 7) __cpuid_count(7, 0, regs7[0], regs7[1], regs7[2], regs7[3]);
+    if(regs1[2] & (1u << 27)){
+        unsigned int lo, hi;
+        __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        xcr0 = ((unsigned long long)hi << 32) | lo;
+    }
+#   endif
+    // os has to save ymm (and zmm, opmask) registers on top of cpu supporting the instructions
+    bool osAvx = (xcr0 & 0x06) == 0x06;
+    bool osAvx512 = (xcr0 & 0xE6) == 0xE6;
+    // avx, avx2, bmi1 and popcnt, avx512 row runs avx2 kernels too so it needs all of them as well
+    bool avx2 = osAvx && (regs1[2] & (1u << 28)) && (regs7[1] & (1u << 5)) && (regs7[1] & (1u << 3)) && (regs1[2] & (1u << 23));
+    if(avx2 && osAvx512 && (regs7[1] & (1u << 16))) return UHM_ISA_AVX512;
+    if(avx2) return UHM_ISA_AVX2;
+    if(regs1[3] & (1u << 26)) return UHM_ISA_SSE2;
+#endif
+    return UHM_ISA_SCALAR;
+}
+
+const uhm_kernels* uhm_active_kernels = NULL;
+volatile int32_t uhm_kernels_once = 0;
+
+/*
+    Picks kernels for this cpu, UHM_FORCE_ISA=scalar|sse2|avx2|avx512 pins the choice
+    forcing instruction set cpu doesn't have falls back to the best supported one
+*/
+void uhm_bind_kernels(void){
+    int isa = uhm_detect_isa();
+    const char* forced = getenv("UHM_FORCE_ISA");
+    if(forced != NULL){
+        int count = sizeof(uhm_kernel_tables) / sizeof(uhm_kernel_tables[0]);
+        int found = -1;
+        for(int i = 0; i < count; i++){
+            if(strcmp(forced, uhm_kernel_tables[i].isa) == 0) found = i;
+        }
+        if(found < 0){
+            UHM_PRINTF("UHM_FORCE_ISA: unknown instruction set %s\n", forced);
+        }else if(found > isa){
+            UHM_PRINTF("UHM_FORCE_ISA: %s isn't supported, using %s\n", forced, uhm_kernel_tables[isa].isa);
+        }else{
+            isa = found;
+        }
+    }
+
+    uhm_active_kernels = &uhm_kernel_tables[isa];
+}
+
+/*
+    Kernels are bound by first call from any thread, uhm_once publishes them to the others
+*/
+const uhm_kernels* uhm_get_kernels(void){
+    uhm_once(&uhm_kernels_once, uhm_bind_kernels);
+    return uhm_active_kernels;
+}
+
+void uhm_fill_color(uint32_t* out, uint32_t color, size_t count){
+    uhm_get_kernels()->fillColor(out, color, count);
+}
+
+/*
+    Coverage mask operations, see uhm_find_bit_scalar and uhm_set_bits_scalar
+*/
+int32_t uhm_find_bit(const uint64_t* bits, int32_t from, int32_t to, bool set){
+    return uhm_get_kernels()->findBit(bits, from, to, set);
+}
+
+int64_t uhm_set_bits(uint64_t* bits, int32_t from, int32_t to){
+    return uhm_get_kernels()->setBits(bits, from, to);
+}
+
+/*
+    Fills target's clip with color, used for background
+*/
+void uhm_target_fill(uhm_target* target, uint32_t color){
+    for(int32_t row = target->clip.y0; row < target->clip.y1; row++){
+        ptrdiff_t offset = (ptrdiff_t)(row - target->originY) * (ptrdiff_t)target->stride + (target->clip.x0 - target->originX);
+        uhm_fill_color((uint32_t*)target->data + offset, color, target->clip.x1 - target->clip.x0);
+    }
+}
+
+/*
+    floor(a / b) for b > 0
+*/
+int64_t uhm_floor_div(int64_t a, int64_t b){
+    int64_t q = a / b;
+    return (a % b != 0 && a < 0) ? q - 1 : q;
+}
+
+/*
+    Linear gradient along the row, t is affine in column so it gets stepped forward instead of projected for every pixel
+    t of every pixel is row's t at gradient's origin column plus distance from it times step in 32.32 fixed point,
+    so color of a pixel doesn't depend on where the span it's in starts, nor on where shape is as long as it moves by whole pixels
+    parts of the span where t rounds to 0 or 1 are split off and filled with constant end colors
+    when t at origin column or at span's ends is too far out for 32.32 fixed point pixels are evaluated in double one by one instead
+*/
+void uhm_linear_span(const uhm_paint* paint, int32_t row, int32_t x0, int32_t x1, uint32_t* out){
+    int32_t count = x1 - x0;
+    double rowT = ((double)row - paint->originRow) * paint->stepRow;
+
+    // t of +-2^29 at origin and span's ends keeps distance times stepFixed under 2^62 and leaves room for rounding
+    const double headroom = (double)((int64_t)1 << 29);
+    double t0 = rowT + ((double)x0 - paint->originCol) * paint->stepCol;
+    double t1 = rowT + ((double)x1 - paint->originCol) * paint->stepCol;
+    if(!(fabs(rowT) < headroom && fabs(t0) < headroom && fabs(t1) < headroom)){
+        for(int32_t j = x0; j < x1; j++) out[j - x0] = uhm_paint_color(paint, row, j);
+        return;
+    }
+
+    int64_t stepFixed = (int64_t)(paint->stepCol * 4294967296.0);
+    int64_t tFixed = (int64_t)(rowT * 4294967296.0) + ((int64_t)x0 - paint->originCol) * stepFixed;
+
+    // t rounds to 0 below low and to 1 from high on
+    const int64_t low = (int64_t)1 << 23;
+    const int64_t high = ((int64_t)1 << 32) - low;
+
+    if(stepFixed == 0){
+        int64_t t8 = (tFixed + low) >> 24;
+        uint32_t color = t8 <= 0 ? paint->color : t8 >= 256 ? paint->color2 : uhm_lerpColorsFixed(paint->color, paint->color2, (uint32_t)t8);
+        uhm_fill_color(out, color, count);
+        return;
+    }
+
+    // [head, tail) is where t is strictly between, before it t is clamped to the side it starts at and after it to the other one
+    int64_t head, tail;
+    if(stepFixed > 0){
+        head = -uhm_floor_div(tFixed - low, stepFixed);
+        tail = -uhm_floor_div(tFixed - high, stepFixed);
+    }else{
+        head = uhm_floor_div(tFixed - high, -stepFixed) + 1;
+        tail = uhm_floor_div(tFixed - low, -stepFixed) + 1;
+    }
+    if(head < 0) head = 0;
+    if(head > count) head = count;
+    if(tail < head) tail = head;
+    if(tail > count) tail = count;
+
+    uint32_t headColor = stepFixed > 0 ? paint->color : paint->color2;
+    uint32_t tailColor = stepFixed > 0 ? paint->color2 : paint->color;
+
+    uhm_fill_color(out, headColor, head);
+    uhm_get_kernels()->lerpSpan(paint->color, paint->color2, tFixed + head * stepFixed, stepFixed, out + head, (int32_t)(tail - head));
+    uhm_fill_color(out + tail, tailColor, count - tail);
+}
+
+/*
+    Pixel keeps whichever of its value and tagged color has higher index, pixels are only ever written with tags of their
+    instruction by thread drawing it, so with same index later write wins like it would in sequential render
+*/
+void uhm_store_indexed(volatile uint64_t* pixels, const uint32_t* colors, int32_t count, uint32_t index){
+    uint64_t tag = ((uint64_t)index + 1) << 32;
+    for(int32_t i = 0; i < count; i++){
+        uint64_t current = uhm_atomic_load64(&pixels[i]);
+        while(current <= (tag | 0xFFFFFFFF) && !uhm_atomic_cas64(&pixels[i], current, tag | colors[i])){
+            current = uhm_atomic_load64(&pixels[i]);
+        }
+    }
+}
+
+/*
+    Fill kernel, [x0, x1) span of the row is already known to be inside of the shape
+*/
+void uhm_color_span(uhm_target* target, const uhm_paint* paint, int32_t row, int32_t x0, int32_t x1){
+    if(target->indexBuffer != NULL){
+        // ends of span already taken by later instructions don't need to be colored, span colors don't depend on where it starts
+        volatile uint64_t* indexRow = target->indexBuffer + (ptrdiff_t)(row - target->originY) * (ptrdiff_t)target->stride - target->originX;
+        uint64_t limit = (((uint64_t)target->index + 1) << 32) | 0xFFFFFFFF;
+        while(x0 < x1 && uhm_atomic_load64(&indexRow[x0]) > limit) x0++;
+        while(x1 > x0 && uhm_atomic_load64(&indexRow[x1 - 1]) > limit) x1--;
+        if(x0 == x1) return;
+    }
+    ptrdiff_t offset = (ptrdiff_t)(row - target->originY) * (ptrdiff_t)target->stride + (x0 - target->originX);
+    uint32_t* pixels = target->indexBuffer != NULL ? target->scratch : (uint32_t*)target->data + offset;
+    if(paint->fillType == 'F'){
+        uhm_fill_color(pixels, paint->color, x1 - x0);
+    }
+    else if(paint->fillType == 'L'){
+        uhm_linear_span(paint, row, x0, x1, pixels);
+    }
+    else{
+        uhm_get_kernels()->radialSpan(paint, row, x0, x1, pixels);
+    }
+    if(target->mask != NULL) memset(target->mask + offset, 1, x1 - x0);
+    if(target->indexBuffer != NULL) uhm_store_indexed(target->indexBuffer + offset, pixels, x1 - x0, target->index);
+}
+
+void uhm_fill_span(uhm_target* target, const uhm_paint* paint, int32_t row, int32_t x0, int32_t x1){
+    if(target->covered == NULL){
+        uhm_color_span(target, paint, row, x0, x1);
+        return;
+    }
+    // span splits into runs of pixels no later instruction covered, those are the only ones worth coloring
+    const uint64_t* bits = target->covered + (size_t)(row - target->originY) * target->coveredWords;
+    int32_t at = x0 - target->originX, end = x1 - target->originX;
+    while(true){
+        int32_t runStart = uhm_find_bit(bits, at, end, false);
+        if(runStart == end) return;
+        int32_t runEnd = uhm_find_bit(bits, runStart, end, true);
+        uhm_color_span(target, paint, row, runStart + target->originX, runEnd + target->originX);
+        uhm_box run = {runStart, row, runEnd, row + 1};
+        uhm_append(target->pending, run);
+        at = runEnd;
+    }
+}
+
+/*
+    What one shape gets rasterized with, circles keep their whole pixel center in centerX, centerY and radius in radiusX
+*/
+typedef struct {
+    uint8_t kind;
+    double centerX, centerY;
+    float cosTheta, sinTheta;
+    double radiusX, radiusY;
+    uhm_paint paint;
+} uhm_probe_shape;
+
+/*
+    Shapes recorded from one cell of tiled pattern, shapes of other cells are compared against them moved by (dx, dy) pixels
+    rasterizers and span kernels only look at pixels relative to shape's center and paint's origin,
+    so cell whose every shape matches draws exactly pixels of recorded one moved by (dx, dy)
+*/
+struct uhm_probe {
+    uhm_probe_shape* items;
+    size_t count;
+    size_t capacity;
+    bool recording;
+    bool failed; // recording ran out of memory
+    size_t next;
+    int64_t dx, dy;
+    bool moved; // every shape compared so far matched
+};
+
+// a is b moved by d, checked both ways so rounding of neither sum can hide a difference
+bool uhm_moved_by(double a, double b, int64_t d){
+    return a == b + (double)d && a - (double)d == b;
+}
+
+/*
+    Paints color same pixels same way once moved by (dx, dy), only fields span kernels read are compared
+*/
+bool uhm_paint_moved(const uhm_paint* a, const uhm_paint* b, int64_t dx, int64_t dy){
+    if(a->fillType != b->fillType || a->color != b->color) return false;
+    if(a->fillType == 'F') return true;
+    if(a->color2 != b->color2 || a->originRow != b->originRow + dy || a->originCol != b->originCol + dx) return false;
+    if(a->fillType == 'L') return a->stepRow == b->stepRow && a->stepCol == b->stepCol;
+    return a->invLength == b->invLength;
+}
+
+void uhm_probe_add(uhm_probe* probe, uint8_t kind, double centerX, double centerY, float cosTheta, float sinTheta, double radiusX, double radiusY, const uhm_paint* paint){
+    if(probe->recording){
+        if(probe->failed) return;
+        if(probe->count >= probe->capacity){
+            size_t capacity = probe->capacity == 0 ? UHM_DA_INIT_CAP : probe->capacity*2;
+            uhm_probe_shape* items = (uhm_probe_shape*)UHM_REALLOC(probe->items, capacity*sizeof(uhm_probe_shape));
+            if(items == NULL){
+                probe->failed = true;
+                return;
+            }
+            probe->items = items;
+            probe->capacity = capacity;
+        }
+        uhm_probe_shape* shape = &probe->items[probe->count++];
+        shape->kind = kind;
+        shape->centerX = centerX;
+        shape->centerY = centerY;
+        shape->cosTheta = cosTheta;
+        shape->sinTheta = sinTheta;
+        shape->radiusX = radiusX;
+        shape->radiusY = radiusY;
+        shape->paint = *paint;
+        return;
+    }
+
+    if(!probe->moved) return;
+    if(probe->next >= probe->count){
+        probe->moved = false;
+        return;
+    }
+    const uhm_probe_shape* shape = &probe->items[probe->next++];
+    probe->moved =
+        kind == shape->kind &&
+        uhm_moved_by(centerX, shape->centerX, probe->dx) && uhm_moved_by(centerY, shape->centerY, probe->dy) &&
+        cosTheta == shape->cosTheta && sinTheta == shape->sinTheta &&
+        radiusX == shape->radiusX && radiusY == shape->radiusY &&
+        uhm_paint_moved(paint, &shape->paint, probe->dx, probe->dy);
+}
+
+typedef bool (*uhm_inside_fn)(const void* shape, int32_t row, int32_t col);
+
+/*
+    Turns analytically solved [lo, hi] extent of the row into exact pixel span [*out0, *out1)
+    ends are moved until they agree with shape's own inside test so float rounding can't add or lose pixels on the edges
+    when lo > hi row only grazes the shape and single pixel in between is probed
+*/
+bool uhm_refine_span(uhm_inside_fn inside, const void* shape, int32_t row, double lo, double hi, int32_t clip0, int32_t clip1, int32_t* out0, int32_t* out1){
+    if(lo < clip0) lo = clip0;
+    if(hi > clip1 - 1) hi = clip1 - 1;
+
+    int32_t a = 0, b = -1;
+    if(lo <= hi){
+        a = (int32_t)ceil(lo);
+        b = (int32_t)floor(hi);
+    }
+    if(a > b){
+        double mid = (lo + hi) * 0.5;
+        if(mid != mid) return false;
+        if(mid < clip0) mid = clip0;
+        if(mid > clip1 - 1) mid = clip1 - 1;
+        a = b = (int32_t)floor(mid + 0.5);
+    }
+
+    while(a <= b && !inside(shape, row, a)) a++;
+    while(b >= a && !inside(shape, row, b)) b--;
+    if(a > b) return false;
+    while(a > clip0 && inside(shape, row, a - 1)) a--;
+    while(b < clip1 - 1 && inside(shape, row, b + 1)) b++;
+
+    *out0 = a;
+    *out1 = b + 1;
+    return true;
+}
+
+/*
+    Narrows [*u0, *u1] to values of u for which lo <= k*u + d <= hi
+*/
+void uhm_solve_slab(double k, double d, double lo, double hi, double* u0, double* u1){
+    if(k == 0){
+        if(d < lo || d > hi){
+            *u0 = INFINITY;
+            *u1 = -INFINITY;
+        }
+        return;
+    }
+    double a = (lo - d) / k;
+    double b = (hi - d) / k;
+    if(a > b){
+        double t = a;
+        a = b;
+        b = t;
+    }
+    if(a > *u0) *u0 = a;
+    if(b < *u1) *u1 = b;
+}
+
+typedef struct {
+    float centerX, centerY;
+    float cosTheta, sinTheta;
+    float halfWidth, halfHeight;
+} uhm_rectangle_raster;
+
+bool uhm_rectangle_inside(const void* shape, int32_t i, int32_t j){
+    const uhm_rectangle_raster* r = (const uhm_rectangle_raster*)shape;
+    float localX = (j - r->centerX) * r->cosTheta + (i - r->centerY) * r->sinTheta;
+    float localY = -(j - r->centerX) * r->sinTheta + (i - r->centerY) * r->cosTheta;
+    return localX >= -r->halfWidth && localX <= r->halfWidth && localY >= -r->halfHeight && localY <= r->halfHeight;
+}
+
+void uhm_raster_rectangle(const uhm_rectangle_raster* r, uhm_target* target, const uhm_paint* paint){
+    if(target->probe != NULL){
+        uhm_probe_add(target->probe, 'R', r->centerX, r->centerY, r->cosTheta, r->sinTheta, r->halfWidth, r->halfHeight, paint);
+        return;
+    }
+
+    // screen space bounds of rotated rectangle
+    float extentX = fabsf(r->halfWidth * r->cosTheta) + fabsf(r->halfHeight * r->sinTheta);
+    float extentY = fabsf(r->halfWidth * r->sinTheta) + fabsf(r->halfHeight * r->cosTheta);
+    uhm_box box;
+    if(!uhm_target_clip(target, r->centerX - extentX, r->centerY - extentY, r->centerX + extentX, r->centerY + extentY, &box)) return;
+
+    for(int32_t i = box.y0; i < box.y1; i++){
+        double dy = (double)i - r->centerY;
+        double u0 = -INFINITY, u1 = INFINITY;
+        uhm_solve_slab(r->cosTheta, dy * r->sinTheta, -r->halfWidth, r->halfWidth, &u0, &u1);
+        uhm_solve_slab(-r->sinTheta, dy * r->cosTheta, -r->halfHeight, r->halfHeight, &u0, &u1);
+
+        int32_t spanX0, spanX1;
+        if(uhm_refine_span(uhm_rectangle_inside, r, i, r->centerX + u0, r->centerX + u1, box.x0, box.x1, &spanX0, &spanX1)){
+            uhm_fill_span(target, paint, i, spanX0, spanX1);
+        }
+    }
+}
+
+typedef struct {
+    float centerX, centerY;
+    float cosTheta, sinTheta;
+    float radiusX, radiusY;
+} uhm_ellipse_raster;
+
+bool uhm_ellipse_inside(const void* shape, int32_t i, int32_t j){
+    const uhm_ellipse_raster* r = (const uhm_ellipse_raster*)shape;
+    float localX = (j - r->centerX) * r->cosTheta + (i - r->centerY) * r->sinTheta;
+    float localY = -(j - r->centerX) * r->sinTheta + (i - r->centerY) * r->cosTheta;
+    float normX = localX / r->radiusX;
+    float normY = localY / r->radiusY;
+    return normX * normX + normY * normY <= 1.0f;
+}
+
+void uhm_raster_ellipse(const uhm_ellipse_raster* r, uhm_target* target, const uhm_paint* paint){
+    if(target->probe != NULL){
+        uhm_probe_add(target->probe, 'E', r->centerX, r->centerY, r->cosTheta, r->sinTheta, r->radiusX, r->radiusY, paint);
+        return;
+    }
+    if(r->radiusX == 0 || r->radiusY == 0) return;
+
+    // screen space bounds of rotated ellipse
+    float extentX = sqrtf(r->radiusX*r->cosTheta*r->radiusX*r->cosTheta + r->radiusY*r->sinTheta*r->radiusY*r->sinTheta);
+    float extentY = sqrtf(r->radiusX*r->sinTheta*r->radiusX*r->sinTheta + r->radiusY*r->cosTheta*r->radiusY*r->cosTheta);
+    uhm_box box;
+    if(!uhm_target_clip(target, r->centerX - extentX, r->centerY - extentY, r->centerX + extentX, r->centerY + extentY, &box)) return;
+
+    // for u = x - centerX every row is quadratic A*u^2 + B*u + C <= 0
+    double c = r->cosTheta, s = r->sinTheta;
+    double invRx2 = 1.0 / ((double)r->radiusX * r->radiusX);
+    double invRy2 = 1.0 / ((double)r->radiusY * r->radiusY);
+    double A = c*c*invRx2 + s*s*invRy2;
+
+    for(int32_t i = box.y0; i < box.y1; i++){
+        double dy = (double)i - r->centerY;
+        double B = 2.0*dy*s*c*(invRx2 - invRy2);
+        double C = dy*dy*(s*s*invRx2 + c*c*invRy2) - 1.0;
+        double disc = B*B - 4.0*A*C;
+        double vertex = -B / (2.0*A);
+        double halfSpan = disc > 0 ? sqrt(disc) / (2.0*A) : 0;
+
+        int32_t spanX0, spanX1;
+        if(uhm_refine_span(uhm_ellipse_inside, r, i, r->centerX + vertex - halfSpan, r->centerX + vertex + halfSpan, box.x0, box.x1, &spanX0, &spanX1)){
+            uhm_fill_span(target, paint, i, spanX0, spanX1);
+        }
+    }
+}
+
+/*
+    Circles are rasterized in whole pixels, covering pixels where dx*dx + dy*dy < radius*radius
+    so every row's extent is solved exactly with integer square root
+*/
+void uhm_raster_circle(int32_t centerX, int32_t centerY, int32_t radius, uhm_target* target, const uhm_paint* paint){
+    if(target->probe != NULL){
+        uhm_probe_add(target->probe, 'C', centerX, centerY, 1.0f, 0.0f, radius, radius, paint);
+        return;
+    }
+    if(radius <= 0) return;
+
+    uhm_box box;
+    if(!uhm_target_clip(target, (float)centerX - radius, (float)centerY - radius, (float)centerX + radius - 1, (float)centerY + radius - 1, &box)) return;
+
+    int64_t radiusSq = (int64_t)radius * radius;
+    for(int32_t i = box.y0; i < box.y1; i++){
+        int64_t dy = (int64_t)i - centerY;
+        int64_t limit = radiusSq - dy*dy - 1;
+        if(limit < 0) continue;
+
+        // largest dx where dx*dx <= limit
+        int64_t dx = (int64_t)sqrt((double)limit);
+        while(dx*dx > limit) dx--;
+        while((dx + 1)*(dx + 1) <= limit) dx++;
+
+        int64_t spanX0 = (int64_t)centerX - dx;
+        int64_t spanX1 = (int64_t)centerX + dx + 1;
+        if(spanX0 < box.x0) spanX0 = box.x0;
+        if(spanX1 > box.x1) spanX1 = box.x1;
+        if(spanX0 < spanX1) uhm_fill_span(target, paint, i, (int32_t)spanX0, (int32_t)spanX1);
+    }
+}
+
+#define cx px1
+#define cy py1
+#define radius px2
+
+int uhm_parse_rectangle(uhm_context* context, uhm_rectangle* rectangle, char* data, uint32_t size, uint32_t* cursor){
+    if(context->rotateModifierActive){
+        rectangle->rotation = context->rotateModifierVal;
+        context->rotateModifierActive = false;
+    }
+
+    if(context->scaleModifierActive){
+        rectangle->scale = context->scaleModifierVal;
+        context->scaleModifierActive = false;
+    }else{
+        rectangle->scale = 1.0f;
+    }
+    
+    int e;
+    if(
+        (e=uhm_chopf32(data,size,cursor,&rectangle->x))<0 ||
+        (e=uhm_chopf32(data,size,cursor,&rectangle->y))<0 ||
+        (e=uhm_chopf32(data,size,cursor,&rectangle->width))<0 ||
+        (e=uhm_chopf32(data,size,cursor,&rectangle->height))<0 ||
+        (e=uhm_chop8(data,size,cursor,&rectangle->fillType))<0
+    ) return e;
+        
+    if(rectangle->fillType == 'F'){
+        if((e=uhm_chop32(data,size,cursor,&rectangle->color))<0) return e;
+    }
+    else if(rectangle->fillType == 'L'){
+        if(
+            (e=uhm_chopf32(data,size,cursor,&rectangle->px1))<0 ||
+            (e=uhm_chopf32(data,size,cursor,&rectangle->py1))<0 ||
+            (e=uhm_chopf32(data,size,cursor,&rectangle->px2))<0 ||
+            (e=uhm_chopf32(data,size,cursor,&rectangle->py2))<0 ||
+            (e=uhm_chop32(data,size,cursor,&rectangle->color))<0 ||
+            (e=uhm_chop32(data,size,cursor,&rectangle->color2))<0
+        ) return e;
+    }
+    else if(rectangle->fillType == 'C'){
+        if(
+            (e=uhm_chopf32(data,size,cursor,&rectangle->cx))<0 ||
+            (e=uhm_chopf32(data,size,cursor,&rectangle->cy))<0 ||
+            (e=uhm_chopf32(data,size,cursor,&rectangle->radius))<0 ||
+            (e=uhm_chop32(data,size,cursor,&rectangle->color))<0 ||
+            (e=uhm_chop32(data,size,cursor,&rectangle->color2))<0
+        ) return e;
+    }
+    else {
+        UHM_PRINTF("ParseRectangle: UNKNOWN FILL TYPE\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+int uhm_draw_rectangle(uhm_rectangle* rectangle, uhm_target* target, const uhm_transform* transform){
+    float scale = rectangle->scale * transform->scale;
+    float rotate = -(rectangle->rotation + transform->rotation);
+    float centerX = (rectangle->x + transform->x) * target->width;
+    float centerY = (rectangle->y + transform->y) * target->height;
+    // unrotated rectangle turns with level it's in
+    float cosTheta = rectangle->rotation == 0 ? transform->cosRotation : cosf(rotate);
+    float sinTheta = rectangle->rotation == 0 ? transform->sinRotation : sinf(rotate);
+    float halfWidth = (rectangle->width * scale) * target->width / 2.0f;
+    float halfHeight = (rectangle->height * scale) * target->height / 2.0f;
+
+    if(!target->measure) UHM_PRINTF("Drawing rectangle x: %.2f, y: %.2f, width: %.2f, height: %.2f\n", centerX, centerY, halfWidth * 2, halfHeight * 2);
+
+    uhm_paint paint = {0};
+    paint.fillType = rectangle->fillType;
+    paint.color = rectangle->color;
+    paint.color2 = rectangle->color2;
+    paint.px1 = rectangle->px1;
+    paint.py1 = rectangle->py1;
+    paint.px2 = rectangle->px2;
+    paint.py2 = rectangle->py2;
+    paint.rotation = rotate;
+    paint.bbx = uhm_pixel(centerX - halfWidth);
+    paint.bby = uhm_pixel(centerY - halfHeight);
+    paint.bbWidth = uhm_pixel(2 * halfWidth);
+    paint.bbHeight = uhm_pixel(2 * halfHeight);
+
+    uhm_rectangle_raster raster = {centerX, centerY, cosTheta, sinTheta, halfWidth, halfHeight};
+    uhm_paint_setup(&paint);
+
+    uhm_raster_rectangle(&raster, target, &paint);
+
+    return 0;
+}
+
+int uhm_parse_circle(uhm_context* context, uhm_circle* circle, char* data, uint32_t size, uint32_t* cursor){
+    if(context->rotateModifierActive){
+        circle->rotation = context->rotateModifierVal;
+        context->rotateModifierActive = false;
+    }
+
+    if(context->scaleModifierActive){
+        circle->scale = context->scaleModifierVal;
+        context->scaleModifierActive = false;
     }else{
-        rectangle->scale = 1.0f;
+        circle->scale = 1.0f;
+    }
+
+    int e;
+    if(
+        (e=uhm_chopf32(data,size,cursor,&circle->x))<0||
+        (e=uhm_chopf32(data,size,cursor,&circle->y))<0||
+        (e=uhm_chopf32(data,size,cursor,&circle->r))<0||
+        (e=uhm_chop8(data,size,cursor,&circle->fillType))<0
+    ) return e;
+        
+    if(circle->fillType == 'F'){
+        if((e=uhm_chop32(data,size,cursor,&circle->color))<0) return e;
+    }
+    else if(circle->fillType == 'L'){
+        if(
+            (e=uhm_chopf32(data,size,cursor,&circle->px1))<0||
+            (e=uhm_chopf32(data,size,cursor,&circle->py1))<0||
+            (e=uhm_chopf32(data,size,cursor,&circle->px2))<0||
+            (e=uhm_chopf32(data,size,cursor,&circle->py2))<0||
+            (e=uhm_chop32(data,size,cursor,&circle->color))<0||
+            (e=uhm_chop32(data,size,cursor,&circle->color2))<0
+        ) return e;
+    }
+    else if(circle->fillType == 'C'){
+        if(
+            (e=uhm_chopf32(data,size,cursor,&circle->cx))<0||
+            (e=uhm_chopf32(data,size,cursor,&circle->cy))<0||
+            (e=uhm_chopf32(data,size,cursor,&circle->radius))<0||
+            (e=uhm_chop32(data,size,cursor,&circle->color))<0||
+            (e=uhm_chop32(data,size,cursor,&circle->color2))<0
+        ) return e;
+    }
+
+    else {
+        UHM_PRINTF("ParseCircle: UNKNOWN FILL TYPE\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+int uhm_draw_circle(uhm_circle* circle, uhm_target* target, const uhm_transform* transform){
+    float scale = circle->scale * transform->scale;
+    float rotate = circle->rotation + transform->rotation;
+    float pixelX = (circle->x+transform->x)*target->width;
+    float pixelY = (circle->y+transform->y)*target->width;
+    float pixelR = (circle->r*scale)*target->width;
+    // converting is only defined in range, circles further out are drawn as round ellipses in floats instead
+    bool whole = fabsf(pixelX) < UHM_CIRCLE_FAR && fabsf(pixelY) < UHM_CIRCLE_FAR && fabsf(pixelR) < UHM_CIRCLE_FAR;
+    int32_t realX = whole ? (int32_t)pixelX : 0;
+    int32_t realY = whole ? (int32_t)pixelY : 0;
+    int32_t realR = whole ? (int32_t)pixelR : 0;
+    // radius under one pixel draws nothing as whole circle, so it doesn't as far one either
+    if(!whole && !(pixelR >= 1.0f)) return 0;
+
+    if(!target->measure){
+        if(whole) UHM_PRINTF("Drawing circle x: %d y: %d radius: %d\n",realX,realY,realR);
+        else UHM_PRINTF("Drawing far circle x: %.2f y: %.2f radius: %.2f\n",pixelX,pixelY,pixelR);
+    }
+
+    uhm_paint paint = {0};
+    paint.fillType = circle->fillType;
+    paint.color = circle->color;
+    paint.color2 = circle->color2;
+    paint.px1 = circle->px1;
+    paint.py1 = circle->py1;
+    paint.px2 = circle->px2;
+    paint.py2 = circle->py2;
+    paint.rotation = -rotate;
+    paint.bbx = whole ? realX - realR : uhm_pixel(pixelX - pixelR);
+    paint.bby = whole ? realY - realR : uhm_pixel(pixelY - pixelR);
+    paint.bbWidth = whole ? realR*2 : uhm_pixel(pixelR*2);
+    paint.bbHeight = whole ? realR*2 : uhm_pixel(pixelR*2);
+
+    uhm_paint_setup(&paint);
+
+    if(whole){
+        uhm_raster_circle(realX, realY, realR, target, &paint);
+    }else{
+        uhm_ellipse_raster raster = {pixelX, pixelY, 1.0f, 0.0f, pixelR, pixelR};
+        uhm_raster_ellipse(&raster, target, &paint);
+    }
+
+    return 0;
+}
+
+int uhm_parse_ellipse(uhm_context* context, uhm_ellipse* ellipse, char* data, uint32_t size, uint32_t* cursor){
+    if(context->rotateModifierActive){
+        ellipse->rotation = context->rotateModifierVal;
+        context->rotateModifierActive = false;
+    }
+
+    if(context->scaleModifierActive){
+        ellipse->scale = context->scaleModifierVal;
+        context->scaleModifierActive = false;
+    }else{
+        ellipse->scale = 1.0f;
+    }
+
+    int e;
+    if(
+        (e=uhm_chopf32(data,size,cursor,&ellipse->x))<0||
+        (e=uhm_chopf32(data,size,cursor,&ellipse->y))<0||
+        (e=uhm_chopf32(data,size,cursor,&ellipse->rw))<0||
+        (e=uhm_chopf32(data,size,cursor,&ellipse->rh))<0||
+        (e=uhm_chop8(data,size,cursor,&ellipse->fillType))<0
+    ) return e;
+        
+    if(ellipse->fillType == 'F'){
+        if((e=uhm_chop32(data,size,cursor,&ellipse->color))<0) return e;
+    }
+    else if(ellipse->fillType == 'L'){
+        if(
+            (e=uhm_chopf32(data,size,cursor,&ellipse->px1))<0||
+            (e=uhm_chopf32(data,size,cursor,&ellipse->py1))<0||
+            (e=uhm_chopf32(data,size,cursor,&ellipse->px2))<0||
+            (e=uhm_chopf32(data,size,cursor,&ellipse->py2))<0||
+            (e=uhm_chop32(data,size,cursor,&ellipse->color))<0||
+            (e=uhm_chop32(data,size,cursor,&ellipse->color2))<0
+        ) return e;
+    }
+    else if(ellipse->fillType == 'C'){
+        if(
+            (e=uhm_chopf32(data,size,cursor,&ellipse->cx))<0||
+            (e=uhm_chopf32(data,size,cursor,&ellipse->cy))<0||
+            (e=uhm_chopf32(data,size,cursor,&ellipse->radius))<0||
+            (e=uhm_chop32(data,size,cursor,&ellipse->color))<0||
+            (e=uhm_chop32(data,size,cursor,&ellipse->color2))<0
+        ) return e;
+    }
+
+    else {
+        UHM_PRINTF("ParseCircle: UNKNOWN FILL TYPE\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+int uhm_draw_ellipse(uhm_ellipse* ellipse, uhm_target* target, const uhm_transform* transform) {
+    float scale = ellipse->scale * transform->scale;
+    float rotate = -(ellipse->rotation + transform->rotation);
+    float realX = (ellipse->x + transform->x) * target->width;
+    float realY = (ellipse->y + transform->y) * target->height;
+    float centerX = realX;
+    float centerY = realY;
+    float realRx = (ellipse->rw*scale) * target->width;
+    float realRy = (ellipse->rh*scale) * target->height;
+    float cosTheta = ellipse->rotation == 0 ? transform->cosRotation : cosf(rotate);
+    float sinTheta = ellipse->rotation == 0 ? transform->sinRotation : sinf(rotate);
+
+    if(!target->measure) UHM_PRINTF("Drawing rotated ellipse at center x: %.2f, y: %.2f, rx: %.2f, ry: %.2f, rotation: %.2f radians\n", centerX, centerY, realRx, realRy, rotate);
+
+    uhm_paint paint = {0};
+    paint.fillType = ellipse->fillType;
+    paint.color = ellipse->color;
+    paint.color2 = ellipse->color2;
+    paint.px1 = ellipse->px1;
+    paint.py1 = ellipse->py1;
+    paint.px2 = ellipse->px2;
+    paint.py2 = ellipse->py2;
+    paint.rotation = rotate;
+    paint.bbx = uhm_pixel(realX - realRx);
+    paint.bby = uhm_pixel(realY - realRy);
+    paint.bbWidth = uhm_pixel(realRx * 2);
+    paint.bbHeight = uhm_pixel(realRy * 2);
+
+    uhm_ellipse_raster raster = {centerX, centerY, cosTheta, sinTheta, realRx, realRy};
+    uhm_paint_setup(&paint);
+
+    uhm_raster_ellipse(&raster, target, &paint);
+
+    return 0;
+}
+
+#undef cx
+#undef cy
+#undef radius
+
+int uhm_parse_instruction(uhm_context* context, char* data, uint32_t size, uint32_t* cursor, uhm_instruction* instruction);
+int uhm_draw_instruction(uhm_context* context, uhm_instruction* instruction, uhm_target* target, const uhm_transform* transform);
+int uhm_collect_step(uhm_instances* instances);
+int uhm_get_location(uhm_instruction* instruction, float* out_x, float* out_y);
+
+/*
+    Draws source (pattern or cell of tiled pattern) with its origin at (transform->x, transform->y)
+*/
+typedef int (*uhm_sprite_body_fn)(uhm_context* context, void* source, uhm_target* target, const uhm_transform* transform);
+
+/*
+    Source drawn once into offscreen pixels at one rotation, scale and subpixel phase
+    runs are covered spans (x0, x1 on row y0) relative to pixel source's origin falls into
+*/
+typedef struct uhm_sprite{
+    int32_t generation;
+    const void* source;
+    float rotation, scale;
+    uint32_t width, height;
+    int32_t phaseX, phaseY;
+
+    bool direct; // too big for cache, placements are drawn shape by shape
+    uhm_box box;
+    uint32_t* pixels;
+    uhm_box* runs;
+    size_t runCount;
+    size_t bytes;
+    size_t bucket;
+    struct uhm_sprite* next;
+    // recency list, newest sprite is the one used last
+    struct uhm_sprite* newer;
+    struct uhm_sprite* older;
+} uhm_sprite;
+
+struct uhm_sprite_cache{
+    size_t budget;
+    size_t used;
+    size_t count;
+    uhm_sprite* newest;
+    uhm_sprite* oldest;
+    uhm_sprite* buckets[UHM_SPRITE_BUCKETS];
+};
+
+uhm_sprite_cache* uhm_sprite_cache_create(size_t budget){
+    uhm_sprite_cache* cache = (uhm_sprite_cache*)UHM_MALLOC(sizeof(uhm_sprite_cache));
+    if(cache == NULL) return NULL;
+    memset(cache, 0, sizeof(uhm_sprite_cache));
+    cache->budget = budget;
+    return cache;
+}
+
+void uhm_sprite_free(uhm_sprite* sprite){
+    if(sprite->pixels != NULL) UHM_FREE(sprite->pixels);
+    if(sprite->runs != NULL) UHM_FREE(sprite->runs);
+    UHM_FREE(sprite);
+}
+
+void uhm_sprite_cache_clear(uhm_sprite_cache* cache){
+    for(size_t i = 0; i < UHM_SPRITE_BUCKETS; i++){
+        uhm_sprite* sprite = cache->buckets[i];
+        while(sprite != NULL){
+            uhm_sprite* next = sprite->next;
+            uhm_sprite_free(sprite);
+            sprite = next;
+        }
+        cache->buckets[i] = NULL;
+    }
+    cache->newest = NULL;
+    cache->oldest = NULL;
+    cache->used = 0;
+    cache->count = 0;
+}
+
+void uhm_sprite_cache_destroy(uhm_sprite_cache* cache){
+    if(cache == NULL) return;
+    uhm_sprite_cache_clear(cache);
+    UHM_FREE(cache);
+}
+
+size_t uhm_sprite_bucket(int32_t generation, const void* source, float rotation, float scale, int32_t phaseX, int32_t phaseY){
+    uint32_t rotationBits, scaleBits;
+    memcpy(&rotationBits, &rotation, 4);
+    memcpy(&scaleBits, &scale, 4);
+    uint64_t hash = (uint64_t)(uintptr_t)source ^ ((uint64_t)(uint32_t)generation << 32);
+    hash = (hash ^ rotationBits) * 0x9E3779B97F4A7C15ull;
+    hash = (hash ^ scaleBits) * 0x9E3779B97F4A7C15ull;
+    hash = (hash ^ (uint32_t)(phaseX * UHM_SPRITE_PHASES + phaseY)) * 0x9E3779B97F4A7C15ull;
+    return (size_t)(hash >> 32) % UHM_SPRITE_BUCKETS;
+}
+
+void uhm_sprite_unlink(uhm_sprite_cache* cache, uhm_sprite* sprite){
+    if(sprite->newer != NULL) sprite->newer->older = sprite->older;
+    else cache->newest = sprite->older;
+    if(sprite->older != NULL) sprite->older->newer = sprite->newer;
+    else cache->oldest = sprite->newer;
+    sprite->newer = sprite->older = NULL;
+}
+
+void uhm_sprite_push_newest(uhm_sprite_cache* cache, uhm_sprite* sprite){
+    sprite->older = cache->newest;
+    if(cache->newest != NULL) cache->newest->newer = sprite;
+    cache->newest = sprite;
+    if(cache->oldest == NULL) cache->oldest = sprite;
+}
+
+/*
+    Drops least recently used sprites until there is room for bytes more
+    oldest sprite comes from end of recency list, only its own bucket chain is walked to unlink it
+*/
+void uhm_sprite_cache_evict(uhm_sprite_cache* cache, size_t bytes){
+    while(cache->oldest != NULL && cache->used + bytes > cache->budget){
+        uhm_sprite* sprite = cache->oldest;
+        uhm_sprite_unlink(cache, sprite);
+        uhm_sprite** link = &cache->buckets[sprite->bucket];
+        while(*link != sprite) link = &(*link)->next;
+        *link = sprite->next;
+        cache->used -= sprite->bytes;
+        cache->count--;
+        uhm_sprite_free(sprite);
+    }
+}
+
+/*
+    Draws source with its origin at origin into sprite's pixels and runs, sprite that would take over budget bytes is made direct instead
+    pixels are at same coordinates as they'd be on canvas, only canvas doesn't limit them
+*/
+int uhm_render_sprite(uhm_context* context, uhm_sprite_body_fn drawBody, void* source, uhm_target* target, const uhm_transform* origin, size_t budget, uhm_sprite* sprite){
+    // canvas doesn't limit sprites, so same sprite works for placements partially outside of it
+    uhm_target measure = uhm_make_target(NULL, target->width, target->height);
+    measure.clip.x0 = measure.clip.y0 = -UHM_SPRITE_FAR;
+    measure.clip.x1 = measure.clip.y1 = UHM_SPRITE_FAR;
+    uhm_target_start_measure(&measure);
+    int e;
+    if((e=drawBody(context, source, &measure, origin))<0) return e;
+
+    size_t spriteWidth = measure.bounds.x1 > measure.bounds.x0 ? measure.bounds.x1 - measure.bounds.x0 : 0;
+    size_t spriteHeight = measure.bounds.y1 > measure.bounds.y0 ? measure.bounds.y1 - measure.bounds.y0 : 0;
+    if(measure.measureBudget <= 0 || spriteWidth * spriteHeight * 5 > budget){
+        sprite->direct = true;
+        return 0;
+    }
+    if(spriteWidth == 0 || spriteHeight == 0) return 0;
+
+    sprite->box = measure.bounds;
+    sprite->pixels = (uint32_t*)UHM_MALLOC(spriteWidth * spriteHeight * 4);
+    uint8_t* mask = (uint8_t*)UHM_MALLOC(spriteWidth * spriteHeight);
+    if(sprite->pixels == NULL || mask == NULL){
+        if(mask != NULL) UHM_FREE(mask);
+        return -1;
+    }
+    memset(mask, 0, spriteWidth * spriteHeight);
+
+    uhm_target offscreen = uhm_make_target((char*)sprite->pixels, target->width, target->height);
+    offscreen.clip = sprite->box;
+    offscreen.originX = sprite->box.x0;
+    offscreen.originY = sprite->box.y0;
+    offscreen.stride = spriteWidth;
+    offscreen.mask = mask;
+    offscreen.sprites = target->sprites;
+    if((e=drawBody(context, source, &offscreen, origin))<0){
+        UHM_FREE(mask);
+        return e;
+    }
+
+    // coverage mask turned into runs, two passes so runs are allocated once
+    for(int pass = 0; pass < 2; pass++){
+        size_t count = 0;
+        for(size_t i = 0; i < spriteHeight; i++){
+            uint8_t* row = mask + i * spriteWidth;
+            for(size_t j = 0; j < spriteWidth;){
+                if(!row[j]){ j++; continue; }
+                size_t start = j;
+                while(j < spriteWidth && row[j]) j++;
+                if(pass == 1){
+                    sprite->runs[count].x0 = sprite->box.x0 + (int32_t)start;
+                    sprite->runs[count].x1 = sprite->box.x0 + (int32_t)j;
+                    sprite->runs[count].y0 = sprite->box.y0 + (int32_t)i;
+                }
+                count++;
+            }
+        }
+        if(pass == 0){
+            if(count > 0) sprite->runs = (uhm_box*)UHM_MALLOC(count * sizeof(uhm_box));
+            if(count > 0 && sprite->runs == NULL){
+                UHM_FREE(mask);
+                return -1;
+            }
+        }
+        sprite->runCount = count;
+    }
+    UHM_FREE(mask);
+
+    sprite->bytes += spriteWidth * spriteHeight * 4 + sprite->runCount * sizeof(uhm_box);
+    return 0;
+}
+
+/*
+    Draws source into new sprite with source's origin at (phaseX, phaseY) / UHM_SPRITE_PHASES pixels
+*/
+uhm_sprite* uhm_build_sprite(uhm_context* context, uhm_sprite_body_fn drawBody, void* source, uhm_target* target, const uhm_transform* level, int32_t phaseX, int32_t phaseY){
+    uhm_sprite* sprite = (uhm_sprite*)UHM_MALLOC(sizeof(uhm_sprite));
+    if(sprite == NULL) return NULL;
+    memset(sprite, 0, sizeof(uhm_sprite));
+    sprite->generation = context->generation;
+    sprite->source = source;
+    sprite->rotation = level->rotation;
+    sprite->scale = level->scale;
+    sprite->width = target->width;
+    sprite->height = target->height;
+    sprite->phaseX = phaseX;
+    sprite->phaseY = phaseY;
+    sprite->bytes = sizeof(uhm_sprite);
+
+    // drawn one canvas away from zero so shapes stay at positive coordinates like on canvas, where truncation is same as flooring
+    float originX = (float)(1.0 + (double)phaseX / UHM_SPRITE_PHASES / target->width);
+    float originY = (float)(1.0 + (double)phaseY / UHM_SPRITE_PHASES / target->height);
+    uhm_transform origin = uhm_transform_at(level, originX, originY);
+
+    if(uhm_render_sprite(context, drawBody, source, target, &origin, target->sprites->budget / 4, sprite) < 0){
+        uhm_sprite_free(sprite);
+        return NULL;
+    }
+    return sprite;
+}
+
+void uhm_blit_sprite(const uhm_sprite* sprite, uhm_target* target, int32_t dx, int32_t dy){
+    if(
+        sprite->box.x0 + dx >= target->clip.x1 || sprite->box.x1 + dx <= target->clip.x0 ||
+        sprite->box.y0 + dy >= target->clip.y1 || sprite->box.y1 + dy <= target->clip.y0
+    ) return;
+    size_t spriteWidth = sprite->box.x1 - sprite->box.x0;
+    for(size_t i = 0; i < sprite->runCount; i++){
+        const uhm_box* run = &sprite->runs[i];
+        int32_t row = run->y0 + dy;
+        if(row < target->clip.y0 || row >= target->clip.y1) continue;
+        int32_t x0 = run->x0 + dx > target->clip.x0 ? run->x0 + dx : target->clip.x0;
+        int32_t x1 = run->x1 + dx < target->clip.x1 ? run->x1 + dx : target->clip.x1;
+        if(x0 >= x1) continue;
+
+        const uint32_t* src = sprite->pixels + (size_t)(run->y0 - sprite->box.y0) * spriteWidth + (x0 - dx - sprite->box.x0);
+        ptrdiff_t offset = (ptrdiff_t)(row - target->originY) * (ptrdiff_t)target->stride + (x0 - target->originX);
+        memcpy((uint32_t*)target->data + offset, src, (size_t)(x1 - x0) * 4);
+        if(target->mask != NULL) memset(target->mask + offset, 1, x1 - x0);
+    }
+}
+
+/*
+    Source placed at (transform->x, transform->y) snapped to nearest 1/UHM_SPRITE_PHASES of pixel and drawn as copy of cached sprite
+*/
+int uhm_draw_sprite(uhm_context* context, uhm_sprite_body_fn drawBody, void* source, uhm_target* target, const uhm_transform* transform){
+    float rotate = transform->rotation;
+    float scale = transform->scale;
+    double pixelX = (double)transform->x * target->width * UHM_SPRITE_PHASES;
+    double pixelY = (double)transform->y * target->height * UHM_SPRITE_PHASES;
+    if(!(fabs(pixelX) < UHM_SPRITE_FAR) || !(fabs(pixelY) < UHM_SPRITE_FAR)) return drawBody(context, source, target, transform);
+
+    int64_t snappedX = (int64_t)floor(pixelX + 0.5);
+    int64_t snappedY = (int64_t)floor(pixelY + 0.5);
+    int32_t dx = (int32_t)uhm_floor_div(snappedX, UHM_SPRITE_PHASES);
+    int32_t dy = (int32_t)uhm_floor_div(snappedY, UHM_SPRITE_PHASES);
+    int32_t phaseX = (int32_t)(snappedX - (int64_t)dx * UHM_SPRITE_PHASES);
+    int32_t phaseY = (int32_t)(snappedY - (int64_t)dy * UHM_SPRITE_PHASES);
+
+    uhm_sprite_cache* cache = target->sprites;
+    size_t bucket = uhm_sprite_bucket(context->generation, source, rotate, scale, phaseX, phaseY);
+    uhm_sprite* sprite = cache->buckets[bucket];
+    while(sprite != NULL){
+        if(
+            sprite->generation == context->generation && sprite->source == source &&
+            sprite->rotation == rotate && sprite->scale == scale &&
+            sprite->width == target->width && sprite->height == target->height &&
+            sprite->phaseX == phaseX && sprite->phaseY == phaseY
+        ) break;
+        sprite = sprite->next;
+    }
+
+    if(sprite == NULL){
+        sprite = uhm_build_sprite(context, drawBody, source, target, transform, phaseX, phaseY);
+        if(sprite == NULL) return -1;
+        uhm_sprite_cache_evict(cache, sprite->bytes);
+        sprite->bucket = bucket;
+        sprite->next = cache->buckets[bucket];
+        cache->buckets[bucket] = sprite;
+        cache->used += sprite->bytes;
+        cache->count++;
+        uhm_sprite_push_newest(cache, sprite);
+    }else if(cache->newest != sprite){
+        uhm_sprite_unlink(cache, sprite);
+        uhm_sprite_push_newest(cache, sprite);
+    }
+
+    if(sprite->direct) return drawBody(context, source, target, transform);
+    uhm_blit_sprite(sprite, target, dx - (int32_t)target->width, dy - (int32_t)target->height);
+    return 0;
+}
+
+int uhm_parse_tiledPattern(uhm_context* context, uhm_tiledPattern* tiledPattern, char* data, uint32_t size, uint32_t* cursor){
+    if(context->rotateModifierActive){
+        tiledPattern->rotation = context->rotateModifierVal;
+        context->rotateModifierActive = false;
+    }
+
+    if(context->scaleModifierActive){
+        tiledPattern->scale = context->scaleModifierVal;
+        context->scaleModifierActive = false;
+    }else{
+        tiledPattern->scale = 1.0f;
+    }
+
+    int e;
+    if(
+        (e=uhm_chopf32(data,size,cursor,&tiledPattern->gx))<0||
+        (e=uhm_chopf32(data,size,cursor,&tiledPattern->gy))<0||
+        (e=uhm_chopf32(data,size,cursor,&tiledPattern->ox))<0||
+        (e=uhm_chopf32(data,size,cursor,&tiledPattern->oy))<0||
+        (e=uhm_chop16(data,size,cursor,&tiledPattern->rows))<0||
+        (e=uhm_chop16(data,size,cursor,&tiledPattern->cols))<0
+    ) return e;
+    
+    tiledPattern->instructions.capacity = 0;
+    tiledPattern->instructions.count = 0;
+    tiledPattern->instructions.items = 0;
+
+    while(true){
+        if(*cursor == size){
+                UHM_PRINTF("end clause wasn't found\n");
+                return -1;
+            }
+            uhm_instruction innerInstruction = {0};
+            if((e=uhm_parse_instruction(context, data,size,cursor,&innerInstruction))<0){
+                UHM_PRINTF("couldn't parse instruction\n");
+                return e;
+            }
+
+            if(innerInstruction.opcode == 'P' && innerInstruction.skip_draw == true){
+                UHM_PRINTF("you cannot define pattern insde of tiled pattern\n");
+                return -1;
+            }
+
+            if(innerInstruction.skip_draw) continue;
+            if(innerInstruction.opcode == ']') break;
+
+            if(uhm_arena_append(&context->arena, &tiledPattern->instructions,innerInstruction) < 0){
+                UHM_PRINTF("out of memory\n");
+                return -1;
+            }
+    }
+
+    return 0;
+}
+
+/*
+    One cell of unrotated tiled pattern, all cells are same picture moved by cell offset
+*/
+int uhm_tile_cell_sprite_body(uhm_context* context, void* source, uhm_target* target, const uhm_transform* transform){
+    uhm_tiledPattern* tiledPattern = (uhm_tiledPattern*)source;
+    int e;
+    for(size_t index = 0; index < tiledPattern->instructions.count; index++){
+        if(tiledPattern->instructions.items[index].skip_draw) continue;
+        if((e=uhm_draw_instruction(context, &tiledPattern->instructions.items[index],target,transform))<0) return e;
+    }
+    return 0;
+}
+
+/*
+    Cells of unrotated grid whose steps are whole pixels drawn as copies of one cell, see uhm_draw_tile_copy
+*/
+typedef struct {
+    bool enabled;
+    int64_t stepX, stepY;
+    int32_t row, col; // cell sprite was drawn from
+    uhm_sprite* sprite;
+    uhm_probe probe;
+    size_t hits, misses;
+} uhm_tile_copies;
+
+void uhm_tile_copies_free(uhm_tile_copies* copies){
+    if(copies->sprite != NULL) uhm_sprite_free(copies->sprite);
+    if(copies->probe.items != NULL) UHM_FREE(copies->probe.items);
+    memset(copies, 0, sizeof(uhm_tile_copies));
+}
+
+/*
+    First cell drawn gets its shapes recorded and is drawn into sprite at its own place, then copied from it
+    every later cell is probed and copied with sprite moved by whole cells when all its shapes match, otherwise drawn shape by shape
+    copies stop being tried when sprite can't be made or when cells keep missing
+*/
+int uhm_draw_tile_copy(uhm_context* context, uhm_tiledPattern* tiledPattern, uhm_target* target, const uhm_transform* cell, int32_t i, int32_t j, uhm_tile_copies* copies){
+    // nothing is culled while probing, so probes of all cells list same shapes
+    uhm_target probing = uhm_make_target(NULL, target->width, target->height);
+    probing.clip.x0 = probing.clip.y0 = -UHM_SPRITE_FAR;
+    probing.clip.x1 = probing.clip.y1 = UHM_SPRITE_FAR;
+    probing.probe = &copies->probe;
+
+    int e;
+    if(copies->sprite == NULL){
+        copies->probe.recording = true;
+        if((e=uhm_tile_cell_sprite_body(context, tiledPattern, &probing, cell))<0) return e;
+        copies->probe.recording = false;
+
+        // sprite bigger than target's clip would cost more to make than it saves
+        size_t budget = (size_t)(target->clip.x1 - target->clip.x0) * (size_t)(target->clip.y1 - target->clip.y0) * 5;
+        copies->sprite = (uhm_sprite*)UHM_MALLOC(sizeof(uhm_sprite));
+        if(copies->sprite == NULL) return -1;
+        memset(copies->sprite, 0, sizeof(uhm_sprite));
+        if((e=uhm_render_sprite(context, uhm_tile_cell_sprite_body, tiledPattern, target, cell, budget, copies->sprite))<0) return e;
+        if(copies->sprite->direct || copies->probe.failed){
+            uhm_tile_copies_free(copies);
+            return uhm_tile_cell_sprite_body(context, tiledPattern, target, cell);
+        }
+        copies->row = i;
+        copies->col = j;
+        uhm_blit_sprite(copies->sprite, target, 0, 0);
+        return 0;
+    }
+
+    copies->probe.next = 0;
+    copies->probe.moved = true;
+    copies->probe.dx = (j - copies->col) * copies->stepX;
+    copies->probe.dy = (i - copies->row) * copies->stepY;
+    if((e=uhm_tile_cell_sprite_body(context, tiledPattern, &probing, cell))<0) return e;
+    if(copies->probe.moved && copies->probe.next == copies->probe.count){
+        copies->hits++;
+        uhm_blit_sprite(copies->sprite, target, (int32_t)copies->probe.dx, (int32_t)copies->probe.dy);
+        return 0;
     }
+
+    // rounding of cell positions moved some shape by other than whole cells
+    if(++copies->misses > 8 && copies->misses > copies->hits) uhm_tile_copies_free(copies);
+    return uhm_tile_cell_sprite_body(context, tiledPattern, target, cell);
+}
+
+/*
+    Cell points are (ox*cols/4, oy*rows/4) plus offsets rotated around it, so whole grid fits around that point
+*/
+void uhm_tiledPattern_bounds(const uhm_tiledPattern* tiledPattern, uhm_bounds* bounds){
+    float w = tiledPattern->cols;
+    float h = tiledPattern->rows;
+    float farCol = w/4 > (w - 1) - w/4 ? w/4 : (w - 1) - w/4;
+    float farRow = h/4 > (h - 1) - h/4 ? h/4 : (h - 1) - h/4;
+    float offset = fabsf(tiledPattern->ox) > fabsf(tiledPattern->oy) ? fabsf(tiledPattern->ox) : fabsf(tiledPattern->oy);
+    bounds->x = tiledPattern->gx + tiledPattern->ox*w/4;
+    bounds->y = tiledPattern->gy + tiledPattern->oy*h/4;
+    bounds->near = tiledPattern->cell.near;
+    bounds->far = fabsf(tiledPattern->scale) * (offset * sqrtf(farCol*farCol + farRow*farRow) + tiledPattern->cell.far);
+}
+
+int uhm_draw_tiledPattern(uhm_context* context, uhm_tiledPattern* tiledPattern, uhm_target* target, const uhm_transform* transform){
+    // cells are moved by tiled pattern's own offset, children of a cell are drawn with this level's rotation and scale
+    uhm_transform level = uhm_nest_transform(transform, 0, 0, tiledPattern->rotation, tiledPattern->scale);
+    float scale = level.scale;
+    float rotate = level.rotation;
     
     int e;
+    float w = tiledPattern->cols;
+    float h = tiledPattern->rows;
+
+    // only cells that can reach target's clip get drawn
+    bool culled = target->instances == NULL && tiledPattern->checked && (!tiledPattern->hasCircle || target->width == target->height);
+    double size = target->width > target->height ? target->width : target->height;
+    double cellReach = 0;
+    if(culled){
+        uhm_bounds bounds;
+        uhm_tiledPattern_bounds(tiledPattern, &bounds);
+        double reach = ((double)bounds.near + (double)bounds.far * fabs(transform->scale)) * size;
+        if(uhm_target_misses(target, ((double)transform->x + bounds.x) * target->width, ((double)transform->y + bounds.y) * target->height, reach)) return 0;
+        cellReach = ((double)tiledPattern->cell.near + (double)tiledPattern->cell.far * fabs(scale)) * size;
+    }
+    // cell (i, j) is at base + i*rowStep + j*colStep in pixels
+    double cosTheta = level.cosRotation, sinTheta = level.sinRotation;
+    double colStepX = (double)tiledPattern->ox * scale * cosTheta * target->width;
+    double colStepY = (double)tiledPattern->oy * scale * sinTheta * target->height;
+    double rowStepX = -(double)tiledPattern->ox * scale * sinTheta * target->width;
+    double rowStepY = (double)tiledPattern->oy * scale * cosTheta * target->height;
+    double baseX = ((double)transform->x + tiledPattern->gx + tiledPattern->ox*w/4) * target->width - (colStepX*w + rowStepX*h)/4;
+    double baseY = ((double)transform->y + tiledPattern->gy + tiledPattern->oy*h/4) * target->height - (colStepY*w + rowStepY*h)/4;
+    cellReach += 2 + 1e-5 * (cellReach + fabs(baseX) + fabs(baseY) + (fabs(colStepX) + fabs(colStepY))*w + (fabs(rowStepX) + fabs(rowStepY))*h);
+    double left = target->clip.x0 - cellReach, right = target->clip.x1 + cellReach;
+    double top = target->clip.y0 - cellReach, bottom = target->clip.y1 + cellReach;
+
+    int32_t rowFirst = 0, rowLast = tiledPattern->rows;
+    int32_t colFirst = 0, colLast = tiledPattern->cols;
+    if(culled && rotate == 0){
+        uhm_step_range(baseY, rowStepY, top, bottom, tiledPattern->rows, &rowFirst, &rowLast);
+        uhm_step_range(baseX, colStepX, left, right, tiledPattern->cols, &colFirst, &colLast);
+    }
+
+    // scaled grid is pulled back so its w/4, h/4 point stays put
+    float diffX = 0, diffY = 0;
+    if(scale != 1){
+        float scaledW = w * scale;
+        float scaledH = h * scale;
+        diffX = scaledW/4 - w/4;
+        diffY = scaledH/4 - h/4;
+    }
+
+    // with sprite cache unrotated grid draws every cell as copy of one of few phase specific cells
+    bool periodic = rotate == 0 && target->sprites != NULL && !target->measure && tiledPattern->checked && (!tiledPattern->hasCircle || target->width == target->height);
+
+    // without it cells whole pixels apart are drawn as exact copies of first cell, see uhm_draw_tile_copy
+    // steps only have to round to whole pixels, probing tells whether cells really moved by them
+    // sprite, its moves and target's clip stay well within UHM_SPRITE_FAR so moved runs fit in 32 bits
+    const double bound = UHM_SPRITE_FAR / 2;
+    double wholeStepX = floor(colStepX + 0.5), wholeStepY = floor(rowStepY + 0.5);
+    uhm_tile_copies copies = {0};
+    copies.enabled =
+        rotate == 0 && target->sprites == NULL && !target->measure && target->instances == NULL && target->probe == NULL &&
+        target->covered == NULL && target->indexBuffer == NULL && tiledPattern->checked && (!tiledPattern->hasCircle || target->width == target->height) &&
+        fabs(colStepX - wholeStepX) < 1e-3 && fabs(rowStepY - wholeStepY) < 1e-3 && fabs(wholeStepX) * w < bound && fabs(wholeStepY) * h < bound &&
+        target->clip.x0 > -bound && target->clip.x1 < bound && target->clip.y0 > -bound && target->clip.y1 < bound &&
+        (int64_t)(rowLast - rowFirst) * (colLast - colFirst) > 1;
+    copies.stepX = (int64_t)wholeStepX;
+    copies.stepY = (int64_t)wholeStepY;
+
+    for(int i = rowFirst; i < rowLast; i++){
+        if(culled && rotate != 0){
+            // rotated row is a line across canvas, cells on it can only reach clip between where it enters and leaves clip
+            int32_t first0, last0, first1, last1;
+            uhm_step_range(baseX + i*rowStepX, colStepX, left, right, tiledPattern->cols, &first0, &last0);
+            uhm_step_range(baseY + i*rowStepY, colStepY, top, bottom, tiledPattern->cols, &first1, &last1);
+            colFirst = first0 > first1 ? first0 : first1;
+            colLast = last0 < last1 ? last0 : last1;
+        }
+        for(int j = colFirst; j < colLast; j++){
+            // measuring gave up, bounds are the whole canvas anyway
+            if(target->measure && target->measureBudget <= 0) return 0;
+            if(target->instances != NULL && (e=uhm_collect_step(target->instances))<0) return e;
+
+            // cell offset is same for every child of cell
+            float outX, outY;
+            if(rotate == 0){
+                outX = tiledPattern->ox*scale*j;
+                outY = tiledPattern->oy*scale*i;
+            }
+            else{
+                float cellX = (float)j - w/4;
+                float cellY = i - h/4;
+                float rotateX = cellX*level.cosRotation - cellY*level.sinRotation;
+                float rotateY = cellX*level.sinRotation + cellY*level.cosRotation;
+
+                outX = tiledPattern->ox*scale*(rotateX + w/4);
+                outY = tiledPattern->oy*scale*(rotateY + h/4);
+            }
+
+            if(scale != 1){
+                outX -= tiledPattern->ox*diffX;
+                outY -= tiledPattern->oy*diffY;
+            }
+
+            outX += level.x + tiledPattern->gx;
+            outY += level.y + tiledPattern->gy;
+
+            uhm_transform cell = uhm_transform_at(&level, outX, outY);
+            if(periodic){
+                if((e=uhm_draw_sprite(context, uhm_tile_cell_sprite_body, tiledPattern, target, &cell))<0) return e;
+                continue;
+            }
+            if(copies.enabled){
+                if((e=uhm_draw_tile_copy(context, tiledPattern, target, &cell, i, j, &copies))<0){
+                    uhm_tile_copies_free(&copies);
+                    return e;
+                }
+                continue;
+            }
+            for(size_t index = 0; index < tiledPattern->instructions.count; index++){
+                if(tiledPattern->instructions.items[index].skip_draw) continue;
+                if((e=uhm_draw_instruction(context, &tiledPattern->instructions.items[index],target,&cell))<0) return e;
+            }
+        }
+    }
+    uhm_tile_copies_free(&copies);
+    return 0;
+}
+
+int uhm_parse_pattern(uhm_context* context, char* data, uint32_t size, uint32_t* cursor, uhm_instruction* instruction){
+    int e;
+    uint8_t mode;
+    uint16_t patternID;
     if(
-        (e=uhm_chopf32(data,size,cursor,&rectangle->x))<0 ||
-        (e=uhm_chopf32(data,size,cursor,&rectangle->y))<0 ||
-        (e=uhm_chopf32(data,size,cursor,&rectangle->width))<0 ||
-        (e=uhm_chopf32(data,size,cursor,&rectangle->height))<0 ||
-        (e=uhm_chop8(data,size,cursor,&rectangle->fillType))<0
+        (e=uhm_chop8(data,size,cursor,&mode))<0||
+        (e=uhm_chop16(data,size,cursor,&patternID))<0
     ) return e;
-        
-    if(rectangle->fillType == 'F'){
-        if((e=uhm_chop32(data,size,cursor,&rectangle->color))<0) return e;
-    }
-    else if(rectangle->fillType == 'L'){
+
+    if(mode == 'P'){
+        float x,y;
         if(
-            (e=uhm_chopf32(data,size,cursor,&rectangle->px1))<0 ||
-            (e=uhm_chopf32(data,size,cursor,&rectangle->py1))<0 ||
-            (e=uhm_chopf32(data,size,cursor,&rectangle->px2))<0 ||
-            (e=uhm_chopf32(data,size,cursor,&rectangle->py2))<0 ||
-            (e=uhm_chop32(data,size,cursor,&rectangle->color))<0 ||
-            (e=uhm_chop32(data,size,cursor,&rectangle->color2))<0
+            (e=uhm_chopf32(data,size,cursor,&x))<0||
+            (e=uhm_chopf32(data,size,cursor,&y))<0
         ) return e;
+        instruction->placePattern.patternID = patternID;
+        instruction->placePattern.x = x;
+        instruction->placePattern.y = y;
+        instruction->placePattern.rotation = 0;
+        if(context->rotateModifierActive){
+            instruction->placePattern.rotation = context->rotateModifierVal;
+            context->rotateModifierActive = false;
+        }
+        if(context->scaleModifierActive){
+            instruction->placePattern.scale = context->scaleModifierVal;
+            context->scaleModifierActive = false;
+        }else{
+            instruction->placePattern.scale = 1.0f;
+        }
+        return 0;
     }
-    else if(rectangle->fillType == 'C'){
-        if(
-            (e=uhm_chopf32(data,size,cursor,&rectangle->cx))<0 ||
-            (e=uhm_chopf32(data,size,cursor,&rectangle->cy))<0 ||
-            (e=uhm_chopf32(data,size,cursor,&rectangle->radius))<0 ||
-            (e=uhm_chop32(data,size,cursor,&rectangle->color))<0 ||
-            (e=uhm_chop32(data,size,cursor,&rectangle->color2))<0
-        ) return e;
+    else if(mode == 'R'){
+        instruction->skip_draw = true;
+        uhm_pattern pattern = {0};
+        pattern.patternID = patternID;
+
+        while(true){
+            if(*cursor == size){
+                UHM_PRINTF("end clause wasn't found\n");
+                return -1;
+            }
+            uhm_instruction innerInstruction = {0};
+            if((e=uhm_parse_instruction(context, data,size,cursor,&innerInstruction))<0){
+                UHM_PRINTF("couldn't parse instruction\n");
+                return e;
+            }
+
+            if(innerInstruction.opcode == 'P' && innerInstruction.skip_draw == true){
+                UHM_PRINTF("you cannot define pattern insde of defining pattern\n");
+                return -1;
+            }
+
+            if(innerInstruction.skip_draw) continue;
+            if(innerInstruction.opcode == ']') break;
+
+            if(uhm_arena_append(&context->arena, &pattern.instructions,innerInstruction) < 0){
+                UHM_PRINTF("out of memory\n");
+                return -1;
+            }
+        }
+
+        if(context->patternSlots == NULL){
+            context->patternSlots = (uint32_t*)context->arena.allocator.alloc(context->arena.allocator.user, 65536 * sizeof(uint32_t));
+            if(context->patternSlots == NULL){
+                UHM_PRINTF("out of memory\n");
+                return -1;
+            }
+            memset(context->patternSlots, 0, 65536 * sizeof(uint32_t));
+        }
+        if(uhm_arena_append(&context->arena, &context->patterns, pattern) < 0){
+            UHM_PRINTF("out of memory\n");
+            return -1;
+        }
+        // first definition wins when id is defined twice
+        if(context->patternSlots[patternID] == 0) context->patternSlots[patternID] = context->patterns.count;
+        return 0;
     }
-    else {
-        UHM_PRINTF("ParseRectangle: UNKNOWN FILL TYPE\n");
+    return -1;
+}
+
+int uhm_parse_rotateModifier(uhm_context* context, char* data, uint32_t size, uint32_t* cursor, uhm_instruction* instruction){
+    instruction->skip_draw = true;
+    int e;
+    float intermediate;
+    if((e=uhm_chopf32(data,size,cursor,&intermediate))<0) return e;
+    if(context->rotateModifierActive){
+        context->rotateModifierVal += intermediate;
+    }else{
+        context->rotateModifierVal = intermediate;
+    }
+    context->rotateModifierActive = true;
+    return 0;
+}
+
+int uhm_parse_scaleModifier(uhm_context* context, char* data, uint32_t size, uint32_t* cursor, uhm_instruction* instruction){
+    instruction->skip_draw = true;
+    int e;
+    float intermediate;
+    if((e=uhm_chopf32(data,size,cursor,&intermediate))<0) return e;
+    if(context->scaleModifierActive){
+        context->scaleModifierVal *= intermediate;
+    }else{
+        context->scaleModifierVal = intermediate;
+    }
+    context->scaleModifierActive = true;
+    return 0;
+}
+
+int uhm_draw_pattern_body(uhm_context* context, uhm_pattern* pattern, uhm_target* target, const uhm_transform* transform){
+    float realX = transform->x;
+    float realY = transform->y;
+    float rotate = transform->rotation;
+    float scale = transform->scale;
+    int e;
+    for(int i = 0; i < pattern->instructions.count; i++){
+        if(pattern->instructions.items[i].skip_draw) continue;
+        float outX, outY;
+        float localX, localY;
+        float scaledLocalX, scaledLocalY;
+
+        if(rotate != 0 || scale != 1) {
+            if((e=uhm_get_location(&pattern->instructions.items[i],&localX,&localY))<0) return e;
+            scaledLocalX = localX;
+            scaledLocalY = localY;
+            if(scale != 1){
+                scaledLocalX *= scale;
+                scaledLocalY *= scale;
+            }
+        }
+
+        if(rotate == 0){
+            outX = realX;
+            outY = realY;
+        }else{
+            float rotatedX = (scaledLocalX * transform->cosRotation - scaledLocalY * transform->sinRotation);
+            float rotatedY = (scaledLocalX * transform->sinRotation + scaledLocalY * transform->cosRotation);
+
+            outX = realX + (rotatedX - scaledLocalX);
+            outY = realY + (rotatedY - scaledLocalY);
+
+        }
+
+        if(scale != 1){
+            float diffX = scaledLocalX - localX;
+            float diffY = scaledLocalY - localY;
+
+            outX += diffX;
+            outY += diffY;
+        }
+
+        uhm_transform child = uhm_transform_at(transform, outX, outY);
+        if((e=uhm_draw_instruction(context, &pattern->instructions.items[i],target,&child))<0) return e;
+    }
+    return 0;
+}
+
+int uhm_pattern_sprite_body(uhm_context* context, void* source, uhm_target* target, const uhm_transform* transform){
+    return uhm_draw_pattern_body(context, (uhm_pattern*)source, target, transform);
+}
+
+int uhm_draw_placePattern(uhm_context* context, uhm_place_pattern* patternDesc, uhm_target* target, const uhm_transform* transform){
+    uhm_pattern* pattern = uhm_find_pattern(context, patternDesc->patternID);
+    if(pattern == NULL){
+        UHM_PRINTF("Unknown patternID %d\n",patternDesc->patternID);
+        return -1;
+    }
+    if(target->instances != NULL && uhm_collect_step(target->instances) < 0) return -1;
+
+    uhm_transform level = uhm_nest_transform(transform, patternDesc->x, patternDesc->y, patternDesc->rotation, patternDesc->scale);
+
+    if(target->instances == NULL && pattern->checked == 2 && (!pattern->hasCircle || target->width == target->height)){
+        double size = target->width > target->height ? target->width : target->height;
+        double reach = ((double)pattern->bounds.near + (double)pattern->bounds.far * fabs(level.scale)) * size;
+        if(uhm_target_misses(target, (double)level.x * target->width, (double)level.y * target->height, reach)) return 0;
+    }
+
+    if(target->sprites != NULL && !target->measure && pattern->checked == 2 && (!pattern->hasCircle || target->width == target->height)){
+        return uhm_draw_sprite(context, uhm_pattern_sprite_body, pattern, target, &level);
+    }
+    return uhm_draw_pattern_body(context, pattern, target, &level);
+}
+
+int uhm_parse_rectangle_instruction(uhm_context* context, char* data, uint32_t size, uint32_t* cursor, uhm_instruction* instruction){
+    return uhm_parse_rectangle(context, &instruction->rectangle, data,size,cursor);
+}
+
+int uhm_parse_circle_instruction(uhm_context* context, char* data, uint32_t size, uint32_t* cursor, uhm_instruction* instruction){
+    return uhm_parse_circle(context, &instruction->circle, data,size,cursor);
+}
+
+int uhm_parse_ellipse_instruction(uhm_context* context, char* data, uint32_t size, uint32_t* cursor, uhm_instruction* instruction){
+    return uhm_parse_ellipse(context, &instruction->ellipse, data,size,cursor);
+}
+
+int uhm_parse_tiledPattern_instruction(uhm_context* context, char* data, uint32_t size, uint32_t* cursor, uhm_instruction* instruction){
+    return uhm_parse_tiledPattern(context, &instruction->tiledPattern, data,size,cursor);
+}
+
+int uhm_parse_end(uhm_context* context, char* data, uint32_t size, uint32_t* cursor, uhm_instruction* instruction){
+    return 0;
+}
+
+int uhm_draw_rectangle_instruction(uhm_context* context, uhm_instruction* instruction, uhm_target* target, const uhm_transform* transform){
+    return uhm_draw_rectangle(&instruction->rectangle, target, transform);
+}
+
+int uhm_draw_circle_instruction(uhm_context* context, uhm_instruction* instruction, uhm_target* target, const uhm_transform* transform){
+    return uhm_draw_circle(&instruction->circle, target, transform);
+}
+
+int uhm_draw_ellipse_instruction(uhm_context* context, uhm_instruction* instruction, uhm_target* target, const uhm_transform* transform){
+    return uhm_draw_ellipse(&instruction->ellipse, target, transform);
+}
+
+int uhm_draw_tiledPattern_instruction(uhm_context* context, uhm_instruction* instruction, uhm_target* target, const uhm_transform* transform){
+    return uhm_draw_tiledPattern(context, &instruction->tiledPattern, target, transform);
+}
+
+int uhm_draw_placePattern_instruction(uhm_context* context, uhm_instruction* instruction, uhm_target* target, const uhm_transform* transform){
+    return uhm_draw_placePattern(context, &instruction->placePattern, target, transform);
+}
+
+void uhm_rectangle_location(const uhm_instruction* instruction, float* out_x, float* out_y){
+    *out_x = instruction->rectangle.x;
+    *out_y = instruction->rectangle.y;
+}
+
+void uhm_circle_location(const uhm_instruction* instruction, float* out_x, float* out_y){
+    *out_x = instruction->circle.x;
+    *out_y = instruction->circle.y;
+}
+
+void uhm_ellipse_location(const uhm_instruction* instruction, float* out_x, float* out_y){
+    *out_x = instruction->ellipse.x;
+    *out_y = instruction->ellipse.y;
+}
+
+void uhm_tiledPattern_location(const uhm_instruction* instruction, float* out_x, float* out_y){
+    *out_x = instruction->tiledPattern.ox;
+    *out_y = instruction->tiledPattern.oy;
+}
+
+void uhm_placePattern_location(const uhm_instruction* instruction, float* out_x, float* out_y){
+    *out_x = instruction->placePattern.x;
+    *out_y = instruction->placePattern.y;
+}
+
+/*
+    What every opcode does, indexed by opcode byte, NULL parse means unknown opcode and NULL draw means it's never drawn
+    parse fills instruction after its opcode, location is point patterns rotate and scale instruction around
+    bounds gives its uhm_bounds, validate checks it can be drawn (NULL when there's nothing to check)
+    shapes are drawn directly and are what instances of flattened programs are made of
+    new opcode gets its handlers in uhm_fill_opcodes and, if it needs to store anything, its member in union of uhm_instruction
+*/
+typedef int (*uhm_parse_fn)(uhm_context* context, char* data, uint32_t size, uint32_t* cursor, uhm_instruction* instruction);
+typedef int (*uhm_draw_fn)(uhm_context* context, uhm_instruction* instruction, uhm_target* target, const uhm_transform* transform);
+typedef void (*uhm_location_fn)(const uhm_instruction* instruction, float* out_x, float* out_y);
+typedef void (*uhm_bounds_fn)(uhm_context* context, uhm_instruction* instruction, uhm_bounds* bounds);
+typedef int (*uhm_validate_fn)(uhm_context* context, uhm_instruction* instruction, bool* hasCircle);
+
+typedef struct {
+    uhm_parse_fn parse[256];
+    uhm_draw_fn draw[256];
+    uhm_location_fn location[256];
+    uhm_bounds_fn bounds[256];
+    uhm_validate_fn validate[256];
+    bool shape[256];
+} uhm_opcode_table;
+
+const uhm_opcode_table* uhm_get_opcodes(void);
+
+int uhm_parse_instruction(uhm_context* context, char* data, uint32_t size, uint32_t* cursor, uhm_instruction* instruction){
+    int e;
+    uint8_t opcode;
+    if((e=uhm_chop8(data,size,cursor,&opcode))<0) return e;
+
+    memset(instruction, 0, sizeof(uhm_instruction));
+    instruction->opcode = opcode;
+
+    uhm_parse_fn parse = uhm_get_opcodes()->parse[opcode];
+    if(parse == NULL){
+        UHM_PRINTF("Parse: Unknown Opcode: %c\n", opcode);
+        return -1;
+    }
+    return parse(context, data,size,cursor,instruction);
+}
+
+int uhm_get_location(uhm_instruction* instruction, float* out_x, float* out_y){
+    uhm_location_fn location = uhm_get_opcodes()->location[instruction->opcode];
+    if(location == NULL){
+        UHM_PRINTF("GetInstructionLocation: Unknown Opcode %c\n", instruction->opcode);
         return -1;
     }
-
+    location(instruction, out_x, out_y);
     return 0;
 }
 
-int uhm_draw_rectangle(uhm_rectangle* rectangle,uint32_t width, uint32_t height, char* output_data, float gx, float gy, float rotateIN, float scaleIN){
-    float scale = rectangle->scale * scaleIN;
-    float rotate = -(rectangle->rotation + rotateIN);
-    float centerX = (rectangle->x + gx) * width;
-    float centerY = (rectangle->y + gy) * height;
-    float cosTheta = cosf(rotate);
-    float sinTheta = sinf(rotate);
-    float halfWidth = (rectangle->width * scale) * width / 2.0f;
-    float halfHeight = (rectangle->height * scale) * height / 2.0f;
-
-    UHM_PRINTF("Drawing rectangle x: %.2f, y: %.2f, width: %.2f, height: %.2f\n", centerX, centerY, halfWidth * 2, halfHeight * 2);
-
-    for (int32_t i = 0; i < height; i++) {
-        for (int32_t j = 0; j < width; j++) {
-            float localX = (j - centerX) * cosTheta + (i - centerY) * sinTheta;
-            float localY = -(j - centerX) * sinTheta + (i - centerY) * cosTheta;
-            if (localX >= -halfWidth && localX <= halfWidth && localY >= -halfHeight && localY <= halfHeight) {
-                float normX = (localX + halfWidth) / (2 * halfWidth);
-                float normY = (localY + halfHeight) / (2 * halfHeight);
-                uint32_t color = rectangle->color;
-                if (rectangle->fillType == 'L') {
-                    float rotatedPx1 = ((rectangle->px1 - 0.5) * cosf(rotate) - (rectangle->py1 - 0.5) * sinf(rotate)) + 0.5;
-                    float rotatedPy1 = ((rectangle->px1 - 0.5) * sinf(rotate) + (rectangle->py1 - 0.5) * cosf(rotate)) + 0.5;
-                    float rotatedPx2 = ((rectangle->px2 - 0.5) * cosf(rotate) - (rectangle->py2 - 0.5) * sinf(rotate)) + 0.5;
-                    float rotatedPy2 = ((rectangle->px2 - 0.5) * sinf(rotate) + (rectangle->py2 - 0.5) * cosf(rotate)) + 0.5;
-                    color = uhm_linearGetColor(
-                        i, j, centerX - halfWidth, centerY - halfHeight,
-                        2 * halfWidth, 2 * halfHeight,
-                        rotatedPx1, rotatedPy1, rotatedPx2, rotatedPy2,
-                        rectangle->color, rectangle->color2);
-                } else if (rectangle->fillType == 'C') {
-                    float rotatedCx = ((rectangle->cx - 0.5) * cosf(rotate) - (rectangle->cy - 0.5) * sinf(rotate)) + 0.5;
-                    float rotatedCy = ((rectangle->cx - 0.5) * sinf(rotate) + (rectangle->cy - 0.5) * cosf(rotate)) + 0.5;
-                    color = uhm_circularGetColor(
-                        i, j, centerX - halfWidth, centerY - halfHeight,
-                        2 * halfWidth, 2 * halfHeight,
-                        rotatedCx, rotatedCy, rectangle->radius,
-                        rectangle->color, rectangle->color2);
-                }
-                ((uint32_t*)output_data)[i * width + j] = color;
-            }
-        }
-    }
-
+/*
+    One more tiled cell or pattern placement walked while collecting, fails once step budget is used up
+*/
+int uhm_collect_step(uhm_instances* instances){
+    if(instances->steps >= instances->stepBudget) return -1;
+    instances->steps++;
     return 0;
 }
 
-typedef struct {
-    float x,y,r,px1,py1,px2,py2;
-    uint8_t fillType;
-    uint32_t color,color2;
-    float rotation;
-    float scale;
-} uhm_circle;
+/*
+    Shape added to instances being collected, arrays are NULL while only counting, fails once capacity is reached
+*/
+int uhm_collect_instance(uhm_instances* instances, uhm_instruction* instruction, const uhm_transform* transform){
+    if(instances->count >= instances->capacity) return -1;
+    size_t i = instances->count++;
+    if(instances->shape == NULL) return 0;
+    instances->shape[i] = instruction;
+    instances->x[i] = transform->x;
+    instances->y[i] = transform->y;
+    instances->rotation[i] = transform->rotation;
+    instances->scale[i] = transform->scale;
+    instances->cosRotation[i] = transform->cosRotation;
+    instances->sinRotation[i] = transform->sinRotation;
+    instances->order[i] = (uint32_t)i;
+    instances->kind[i] = instruction->opcode;
+    return 0;
+}
 
-int uhm_parse_circle(uhm_circle* circle, char* data, uint32_t size, uint32_t* cursor){
-    if(uhm_rotateModifierActive){
-        circle->rotation = uhm_rotateModifierVal;
-        uhm_rotateModifierActive = false;
+int uhm_draw_instruction(uhm_context* context, uhm_instruction* instruction, uhm_target* target, const uhm_transform* transform){
+    const uhm_opcode_table* opcodes = uhm_get_opcodes();
+    // patterns go on placing their children, only shapes get collected
+    if(target->instances != NULL && opcodes->shape[instruction->opcode]){
+        return uhm_collect_instance(target->instances, instruction, transform);
     }
-
-    if(uhm_scaleModifierActive){
-        circle->scale = uhm_scaleModifierVal;
-        uhm_scaleModifierActive = false;
-    }else{
-        circle->scale = 1.0f;
+    uhm_draw_fn draw = opcodes->draw[instruction->opcode];
+    if(draw == NULL){
+        UHM_PRINTF("Draw: Unknown Opcode %c\n", instruction->opcode);
+        return -1;
     }
+    return draw(context, instruction, target, transform);
+}
 
-    int e;
-    if(
-        (e=uhm_chopf32(data,size,cursor,&circle->x))<0||
-        (e=uhm_chopf32(data,size,cursor,&circle->y))<0||
-        (e=uhm_chopf32(data,size,cursor,&circle->r))<0||
-        (e=uhm_chop8(data,size,cursor,&circle->fillType))<0
-    ) return e;
-        
-    if(circle->fillType == 'F'){
-        if((e=uhm_chop32(data,size,cursor,&circle->color))<0) return e;
-    }
-    else if(circle->fillType == 'L'){
-        if(
-            (e=uhm_chopf32(data,size,cursor,&circle->px1))<0||
-            (e=uhm_chopf32(data,size,cursor,&circle->py1))<0||
-            (e=uhm_chopf32(data,size,cursor,&circle->px2))<0||
-            (e=uhm_chopf32(data,size,cursor,&circle->py2))<0||
-            (e=uhm_chop32(data,size,cursor,&circle->color))<0||
-            (e=uhm_chop32(data,size,cursor,&circle->color2))<0
-        ) return e;
-    }
-    else if(circle->fillType == 'C'){
-        if(
-            (e=uhm_chopf32(data,size,cursor,&circle->cx))<0||
-            (e=uhm_chopf32(data,size,cursor,&circle->cy))<0||
-            (e=uhm_chopf32(data,size,cursor,&circle->radius))<0||
-            (e=uhm_chop32(data,size,cursor,&circle->color))<0||
-            (e=uhm_chop32(data,size,cursor,&circle->color2))<0
-        ) return e;
-    }
+void uhm_rectangle_bounds(uhm_context* context, uhm_instruction* instruction, uhm_bounds* bounds){
+    uhm_rectangle* rectangle = &instruction->rectangle;
+    bounds->x = rectangle->x;
+    bounds->y = rectangle->y;
+    bounds->far = fabsf(rectangle->scale) * sqrtf(rectangle->width*rectangle->width + rectangle->height*rectangle->height) / 2;
+}
 
-    else {
-        UHM_PRINTF("ParseCircle: UNKNOWN FILL TYPE\n");
-        return -1;
-    }
+void uhm_circle_bounds(uhm_context* context, uhm_instruction* instruction, uhm_bounds* bounds){
+    uhm_circle* circle = &instruction->circle;
+    bounds->x = circle->x;
+    bounds->y = circle->y;
+    bounds->far = fabsf(circle->scale * circle->r);
+}
 
-    return 0;
+void uhm_ellipse_bounds(uhm_context* context, uhm_instruction* instruction, uhm_bounds* bounds){
+    uhm_ellipse* ellipse = &instruction->ellipse;
+    bounds->x = ellipse->x;
+    bounds->y = ellipse->y;
+    bounds->far = fabsf(ellipse->scale) * (fabsf(ellipse->rw) > fabsf(ellipse->rh) ? fabsf(ellipse->rw) : fabsf(ellipse->rh));
 }
 
-int uhm_draw_circle(uhm_circle* circle, uint32_t width, uint32_t height, char* output_data, float gx, float gy, float rotateIN, float scaleIN){
-    float scale = circle->scale * scaleIN;
-    float rotate = circle->rotation + rotateIN;
-    int32_t realX = (circle->x+gx)*width;
-    int32_t realY = (circle->y+gy)*width;
-    int32_t realR = (circle->r*scale)*width;
-
-    UHM_PRINTF("Drawing circle x: %d y: %d radius: %d\n",realX,realY,realR);
-
-    for(int32_t i = realY - realR; i < realY + realR; i++){
-        if(i < 0 || i >= width) continue;
-        for(int j = realX - realR; j < realX + realR; j++){
-            if(j < 0 || j >= height) continue;
-            uint32_t y = i - realY;
-            uint32_t x = j - realX;
-            if(y*y + x*x < realR*realR){
-                if(circle->fillType == 'L'){
-                    float rotatedPx1 = ((circle->px1 - 0.5) * cosf(-rotate) - (circle->py1 - 0.5) * sinf(-rotate)) + 0.5;
-                    float rotatedPy1 = ((circle->px1 - 0.5) * sinf(-rotate) + (circle->py1 - 0.5) * cosf(-rotate)) + 0.5;
-                    float rotatedPx2 = ((circle->px2 - 0.5) * cosf(-rotate) - (circle->py2 - 0.5) * sinf(-rotate)) + 0.5;
-                    float rotatedPy2 = ((circle->px2 - 0.5) * sinf(-rotate) + (circle->py2 - 0.5) * cosf(-rotate)) + 0.5;
-
-                    ((uint32_t*)output_data)[i*width + j] = uhm_linearGetColor(
-                        i,j,
-                        realX - realR,realY - realR,
-                        realR*2,realR*2,
-                        rotatedPx1,rotatedPy1,
-                        rotatedPx2,rotatedPy2,
-                        circle->color,circle->color2
-                    );
-                }
-                else if(circle->fillType == 'C'){
-                    float rotatedCx = ((circle->cx - 0.5) * cosf(-rotate) - (circle->cy - 0.5) * sinf(-rotate)) + 0.5;
-                    float rotatedCy = ((circle->cx - 0.5) * sinf(-rotate) + (circle->cy - 0.5) * cosf(-rotate)) + 0.5;
-
-                    ((uint32_t*)output_data)[i*width + j] = uhm_circularGetColor(
-                        i,j,
-                        realX - realR,realY - realR,
-                        realR*2,realR*2,
-                        rotatedCx,rotatedCy,
-                        circle->radius,
-                        circle->color,circle->color2
-                    );
-                }
-                else{
-                    ((uint32_t*)output_data)[i*width + j] = circle->color;
-                }
-            }
-        }
-    }
+void uhm_tiledPattern_instruction_bounds(uhm_context* context, uhm_instruction* instruction, uhm_bounds* bounds){
+    uhm_tiledPattern_bounds(&instruction->tiledPattern, bounds);
+}
 
-    return 0;
+void uhm_placePattern_bounds(uhm_context* context, uhm_instruction* instruction, uhm_bounds* bounds){
+    uhm_place_pattern* patternDesc = &instruction->placePattern;
+    uhm_pattern* pattern = uhm_find_pattern(context, patternDesc->patternID);
+    bounds->x = patternDesc->x;
+    bounds->y = patternDesc->y;
+    bounds->near = pattern->bounds.near;
+    bounds->far = fabsf(patternDesc->scale) * pattern->bounds.far;
 }
 
-typedef struct {
-    float x,y,rw,rh,px1,py1,px2,py2;
-    uint8_t fillType;
-    uint32_t color,color2;
-    float rotation;
-    float scale;
-} uhm_ellipse;
+/*
+    Bounds of instruction whose patterns and tiled patterns are already checked
+*/
+void uhm_get_bounds(uhm_context* context, uhm_instruction* instruction, uhm_bounds* bounds){
+    memset(bounds, 0, sizeof(uhm_bounds));
+    uhm_bounds_fn getBounds = uhm_get_opcodes()->bounds[instruction->opcode];
+    if(getBounds != NULL) getBounds(context, instruction, bounds);
+}
 
-int uhm_parse_ellipse(uhm_ellipse* ellipse, char* data, uint32_t size, uint32_t* cursor){
-    if(uhm_rotateModifierActive){
-        ellipse->rotation = uhm_rotateModifierVal;
-        uhm_rotateModifierActive = false;
-    }
+int uhm_validate_instruction(uhm_context* context, uhm_instruction* instruction, bool* hasCircle);
 
-    if(uhm_scaleModifierActive){
-        ellipse->scale = uhm_scaleModifierVal;
-        uhm_scaleModifierActive = false;
-    }else{
-        ellipse->scale = 1.0f;
+int uhm_validate_circle(uhm_context* context, uhm_instruction* instruction, bool* hasCircle){
+    *hasCircle = true;
+    return 0;
+}
+
+int uhm_validate_tiledPattern(uhm_context* context, uhm_instruction* instruction, bool* hasCircle){
+    int e;
+    uhm_tiledPattern* tiledPattern = &instruction->tiledPattern;
+    if(tiledPattern->rows == 0 || tiledPattern->cols == 0) return 0;
+    // children of every cell are drawn at cell's point, only their own size scales
+    uhm_bounds cell = {0};
+    for(size_t i = 0; i < tiledPattern->instructions.count; i++){
+        if((e=uhm_validate_instruction(context, &tiledPattern->instructions.items[i], &tiledPattern->hasCircle))<0) return e;
+        uhm_bounds child;
+        uhm_get_bounds(context, &tiledPattern->instructions.items[i], &child);
+        float near = sqrtf(child.x*child.x + child.y*child.y) + child.near;
+        if(near > cell.near) cell.near = near;
+        if(child.far > cell.far) cell.far = child.far;
     }
+    tiledPattern->cell = cell;
+    tiledPattern->checked = true;
+    if(tiledPattern->hasCircle) *hasCircle = true;
+    return 0;
+}
 
+int uhm_validate_placePattern(uhm_context* context, uhm_instruction* instruction, bool* hasCircle){
     int e;
-    if(
-        (e=uhm_chopf32(data,size,cursor,&ellipse->x))<0||
-        (e=uhm_chopf32(data,size,cursor,&ellipse->y))<0||
-        (e=uhm_chopf32(data,size,cursor,&ellipse->rw))<0||
-        (e=uhm_chopf32(data,size,cursor,&ellipse->rh))<0||
-        (e=uhm_chop8(data,size,cursor,&ellipse->fillType))<0
-    ) return e;
-        
-    if(ellipse->fillType == 'F'){
-        if((e=uhm_chop32(data,size,cursor,&ellipse->color))<0) return e;
+    uint16_t patternID = instruction->placePattern.patternID;
+    uhm_pattern* pattern = uhm_find_pattern(context, patternID);
+    if(pattern == NULL){
+        UHM_PRINTF("Unknown patternID %d\n",patternID);
+        return -1;
     }
-    else if(ellipse->fillType == 'L'){
-        if(
-            (e=uhm_chopf32(data,size,cursor,&ellipse->px1))<0||
-            (e=uhm_chopf32(data,size,cursor,&ellipse->py1))<0||
-            (e=uhm_chopf32(data,size,cursor,&ellipse->px2))<0||
-            (e=uhm_chopf32(data,size,cursor,&ellipse->py2))<0||
-            (e=uhm_chop32(data,size,cursor,&ellipse->color))<0||
-            (e=uhm_chop32(data,size,cursor,&ellipse->color2))<0
-        ) return e;
+    if(pattern->checked == 2){
+        if(pattern->hasCircle) *hasCircle = true;
+        return 0;
     }
-    else if(ellipse->fillType == 'C'){
-        if(
-            (e=uhm_chopf32(data,size,cursor,&ellipse->cx))<0||
-            (e=uhm_chopf32(data,size,cursor,&ellipse->cy))<0||
-            (e=uhm_chopf32(data,size,cursor,&ellipse->radius))<0||
-            (e=uhm_chop32(data,size,cursor,&ellipse->color))<0||
-            (e=uhm_chop32(data,size,cursor,&ellipse->color2))<0
-        ) return e;
+    if(pattern->checked == 1){
+        UHM_PRINTF("pattern %d places itself\n",patternID);
+        return -1;
     }
 
-    else {
-        UHM_PRINTF("ParseCircle: UNKNOWN FILL TYPE\n");
+    // children are moved by their location scaled and rotated around placement point
+    pattern->checked = 1;
+    uhm_bounds body = {0};
+    for(size_t i = 0; i < pattern->instructions.count; i++){
+        if(pattern->instructions.items[i].skip_draw) continue;
+        if((e=uhm_validate_instruction(context, &pattern->instructions.items[i], &pattern->hasCircle))<0) return e;
+        uhm_bounds child;
+        float localX, localY;
+        uhm_get_bounds(context, &pattern->instructions.items[i], &child);
+        if((e=uhm_get_location(&pattern->instructions.items[i], &localX, &localY))<0) return e;
+        float near = sqrtf((child.x - localX)*(child.x - localX) + (child.y - localY)*(child.y - localY)) + child.near;
+        float far = sqrtf(localX*localX + localY*localY) + child.far;
+        if(near > body.near) body.near = near;
+        if(far > body.far) body.far = far;
+    }
+    pattern->bounds = body;
+    pattern->checked = 2;
+    if(pattern->hasCircle) *hasCircle = true;
+    return 0;
+}
+
+/*
+    Makes sure drawing instruction can't fail, every placed pattern has to be defined by now and can't place itself
+    patterns remember they were checked so every pattern body is walked only once
+    *hasCircle gets set when instruction draws any circle
+*/
+int uhm_validate_instruction(uhm_context* context, uhm_instruction* instruction, bool* hasCircle){
+    const uhm_opcode_table* opcodes = uhm_get_opcodes();
+    if(opcodes->draw[instruction->opcode] == NULL){
+        UHM_PRINTF("Draw: Unknown Opcode %c\n", instruction->opcode);
         return -1;
     }
+    uhm_validate_fn validate = opcodes->validate[instruction->opcode];
+    return validate != NULL ? validate(context, instruction, hasCircle) : 0;
+}
 
-    return 0;
+void uhm_set_opcode(uhm_opcode_table* table, uint8_t opcode, uhm_parse_fn parse, uhm_draw_fn draw, uhm_location_fn location, uhm_bounds_fn bounds, uhm_validate_fn validate, bool shape){
+    table->parse[opcode] = parse;
+    table->draw[opcode] = draw;
+    table->location[opcode] = location;
+    table->bounds[opcode] = bounds;
+    table->validate[opcode] = validate;
+    table->shape[opcode] = shape;
 }
 
+uhm_opcode_table uhm_opcodes;
+volatile int32_t uhm_opcodes_once = 0;
+
+void uhm_fill_opcodes(void){
+    uhm_set_opcode(&uhm_opcodes, 'R', uhm_parse_rectangle_instruction, uhm_draw_rectangle_instruction, uhm_rectangle_location, uhm_rectangle_bounds, NULL, true);
+    uhm_set_opcode(&uhm_opcodes, 'C', uhm_parse_circle_instruction, uhm_draw_circle_instruction, uhm_circle_location, uhm_circle_bounds, uhm_validate_circle, true);
+    uhm_set_opcode(&uhm_opcodes, 'E', uhm_parse_ellipse_instruction, uhm_draw_ellipse_instruction, uhm_ellipse_location, uhm_ellipse_bounds, NULL, true);
+    uhm_set_opcode(&uhm_opcodes, 'T', uhm_parse_tiledPattern_instruction, uhm_draw_tiledPattern_instruction, uhm_tiledPattern_location, uhm_tiledPattern_instruction_bounds, uhm_validate_tiledPattern, false);
+    uhm_set_opcode(&uhm_opcodes, 'P', uhm_parse_pattern, uhm_draw_placePattern_instruction, uhm_placePattern_location, uhm_placePattern_bounds, uhm_validate_placePattern, false);
+    uhm_set_opcode(&uhm_opcodes, '|', uhm_parse_rotateModifier, NULL, NULL, NULL, NULL, false);
+    uhm_set_opcode(&uhm_opcodes, '\\', uhm_parse_scaleModifier, NULL, NULL, NULL, NULL, false);
+    // closes pattern and tiled pattern definitions
+    uhm_set_opcode(&uhm_opcodes, ']', uhm_parse_end, NULL, NULL, NULL, NULL, false);
+}
 
-int uhm_draw_ellipse(uhm_ellipse* ellipse, uint32_t width, uint32_t height, char* output_data, float gx, float gy, float rotateIN, float scaleIN) {
-    float scale = ellipse->scale * scaleIN;
-    float rotate = -(ellipse->rotation + rotateIN);
-    float realX = (ellipse->x + gx) * width;
-    float realY = (ellipse->y + gy) * height;
-    float centerX = realX;
-    float centerY = realY;
-    float realRx = (ellipse->rw*scale) * width;
-    float realRy = (ellipse->rh*scale) * height;
-    float cosTheta = cosf(rotate);
-    float sinTheta = sinf(rotate);
-
-    UHM_PRINTF("Drawing rotated ellipse at center x: %.2f, y: %.2f, rx: %.2f, ry: %.2f, rotation: %.2f radians\n", centerX, centerY, realRx, realRy, rotate);
-
-    for (int32_t i = 0; i < height; i++) {
-        for (int32_t j = 0; j < width; j++) {
-            float localX = (j - centerX) * cosTheta + (i - centerY) * sinTheta;
-            float localY = -(j - centerX) * sinTheta + (i - centerY) * cosTheta;
-            float normX = localX / realRx;
-            float normY = localY / realRy;
-            if (normX * normX + normY * normY <= 1.0f) {
-                uint32_t color = ellipse->color;
-                float rotatedPx1 = ((ellipse->px1 - 0.5) * cosf(rotate) - (ellipse->py1 - 0.5) * sinf(rotate)) + 0.5;
-                float rotatedPy1 = ((ellipse->px1 - 0.5) * sinf(rotate) + (ellipse->py1 - 0.5) * cosf(rotate)) + 0.5;
-                float rotatedPx2 = ((ellipse->px2 - 0.5) * cosf(rotate) - (ellipse->py2 - 0.5) * sinf(rotate)) + 0.5;
-                float rotatedPy2 = ((ellipse->px2 - 0.5) * sinf(rotate) + (ellipse->py2 - 0.5) * cosf(rotate)) + 0.5;
-
-                if (ellipse->fillType == 'L') {
-                    color = uhm_linearGetColor(
-                        i, j,
-                        realX - realRx, realY - realRy,
-                        realRx * 2, realRy * 2,
-                        rotatedPx1, rotatedPy1,
-                        rotatedPx2, rotatedPy2,
-                        ellipse->color, ellipse->color2
-                    );
-                } else if (ellipse->fillType == 'C') {
-                    float rotatedCx = ((ellipse->cx - 0.5) * cosf(rotate) - (ellipse->cy - 0.5) * sinf(rotate)) + 0.5;
-                    float rotatedCy = ((ellipse->cx - 0.5) * sinf(rotate) + (ellipse->cy - 0.5) * cosf(rotate)) + 0.5;
-
-                    color = uhm_circularGetColor(
-                        i, j,
-                        realX - realRx, realY - realRy,
-                        realRx * 2, realRy * 2,
-                        rotatedCx, rotatedCy,
-                        ellipse->radius,
-                        ellipse->color, ellipse->color2
-                    );
-                }
+/*
+    Table is filled once by first caller from any thread, uhm_once publishes it to the others
+*/
+const uhm_opcode_table* uhm_get_opcodes(void){
+    uhm_once(&uhm_opcodes_once, uhm_fill_opcodes);
+    return &uhm_opcodes;
+}
 
-                ((uint32_t*)output_data)[i * width + j] = color;
-            }
-        }
+/*
+    Forgets defined patterns and pending modifiers so context can parse another file
+    instructions parsed so far are gone too, their memory goes back to arena
+*/
+void uhm_context_reset(uhm_context* context){
+    if(context->patternSlots != NULL){
+        for(size_t i = 0; i < context->patterns.count; i++) context->patternSlots[context->patterns.items[i].patternID] = 0;
     }
+    context->patterns.items = NULL;
+    context->patterns.count = 0;
+    context->patterns.capacity = 0;
+    context->rotateModifierActive = false;
+    context->scaleModifierActive = false;
+    uhm_arena_reset(&context->arena);
+}
 
-    return 0;
+/*
+    Frees everything context holds, struct itself stays usable as zeroed context with same allocator
+*/
+void uhm_context_deinit(uhm_context* context){
+    uhm_context_reset(context);
+    uhm_arena_free(&context->arena);
+    if(context->patternSlots != NULL) context->arena.allocator.free(context->arena.allocator.user, context->patternSlots);
+    uhm_allocator allocator = context->arena.allocator;
+    memset(context, 0, sizeof(uhm_context));
+    context->arena.allocator = allocator;
 }
 
-#undef cx
-#undef cy
-#undef radius
+void uhm_context_set_allocator(uhm_context* context, uhm_allocator allocator){
+    uhm_context_deinit(context);
+    if(allocator.alloc == NULL){
+        allocator.alloc = uhm_default_alloc;
+        allocator.free = uhm_default_free;
+    }
+    context->arena.allocator = allocator;
+}
 
-typedef struct{
-    uint8_t opcode;
-    void* data;
-    bool skip_draw;
-} uhm_instruction;
+uhm_context* uhm_context_create(void){
+    uhm_context* context = (uhm_context*)UHM_MALLOC(sizeof(uhm_context));
+    if(context == NULL) return NULL;
+    memset(context, 0, sizeof(uhm_context));
+    return context;
+}
 
-int uhm_parse_instruction(char* data, uint32_t size, uint32_t* cursor, uhm_instruction* instruction);
-int uhm_draw_instruction(uhm_instruction* instruction, uint32_t width, uint32_t height, char* output_data, float gx, float gy, float rotation, float scaleIN);
-int uhm_get_location(uhm_instruction* instruction, float* out_x, float* out_y);
+void uhm_context_destroy(uhm_context* context){
+    if(context == NULL) return;
+    uhm_context_deinit(context);
+    UHM_FREE(context);
+}
 
-typedef struct {
-    uhm_instruction *items;
-    size_t           count;
-    size_t           capacity;
-} uhm_instructions;
+/*
+    Checks file's magic and reads background color, also forgets patterns of previous file
+*/
+int uhm_parse_header(uhm_context* context, char* data, uint32_t size, uint32_t* cursor, uint32_t* backgroundColor){
+    uhm_context_reset(context);
+    context->generation = uhm_atomic_add(&uhm_generationCounter, 1) + 1;
+    // shape structs with their list entries take few times more memory than their encoding
+    uhm_arena_reserve(&context->arena, (size_t)size * 4);
+
+    if(uhm_expect(data,size,*cursor,'U') != 1) return -1;
+    (*cursor)++;
+    if(uhm_expect(data,size,*cursor,'H') != 1) return -1;
+    (*cursor)++;
+    if(uhm_expect(data,size,*cursor,'M') != 1) return -1;
+    (*cursor)++;
+    UHM_PRINTF("File Verified\n");
 
-typedef struct{
-    float gx,gy;
-    float ox,oy;
-    uint16_t rows, cols;
-    uhm_instructions instructions;
-    float rotation;
-    float scale;
-} uhm_tiledPattern;
+    return uhm_chop32(data,size,cursor,backgroundColor);
+}
+
+int uhm_context_encode_into(uhm_context* context, char* data, uint32_t size, char* out, uint32_t width, uint32_t height, size_t strideBytes){
+    UHM_PRINTF("Got %u bytes\n", size);
+    uhm_target target;
+    if(!uhm_make_strided_target(out, width, height, strideBytes, &target)) return -1;
+    uint32_t cursor = 0;
+
+    // setting image background color
+    uint32_t backgroundColor;
+    int e;
+    if((e=uhm_parse_header(context, data,size,&cursor,&backgroundColor))<0) return e;
+    uhm_target_fill(&target, backgroundColor);
+
+    uhm_instruction instruction = {0};
+    while(cursor < size){
+        instruction = {0};
+        if((e=uhm_parse_instruction(context, data,size,&cursor,&instruction))<0) return e;
 
-int uhm_parse_tiledPattern(uhm_tiledPattern* tiledPattern, char* data, uint32_t size, uint32_t* cursor){
-    if(uhm_rotateModifierActive){
-        tiledPattern->rotation = uhm_rotateModifierVal;
-        uhm_rotateModifierActive = false;
+        if(!instruction.skip_draw){
+            bool hasCircle = false;
+            if(
+                (e=uhm_validate_instruction(context, &instruction, &hasCircle))<0 ||
+                (e=uhm_draw_instruction(context, &instruction,&target, &uhm_identity_transform))<0
+            ) return e;
+        }
     }
 
-    if(uhm_scaleModifierActive){
-        tiledPattern->scale = uhm_scaleModifierVal;
-        uhm_scaleModifierActive = false;
-    }else{
-        tiledPattern->scale = 1.0f;
+    return 0;
+}
+
+char* uhm_context_encode(uhm_context* context, char* data, uint32_t size, uint32_t width, uint32_t height){
+    char* output_data = (char*)UHM_MALLOC((size_t)width*height*4);
+    if(output_data == NULL) return NULL;
+    if(uhm_context_encode_into(context, data, size, output_data, width, height, (size_t)width*4) < 0){
+        UHM_FREE(output_data);
+        return NULL;
     }
+    return output_data;
+}
 
-    int e;
-    if(
-        (e=uhm_chopf32(data,size,cursor,&tiledPattern->gx))<0||
-        (e=uhm_chopf32(data,size,cursor,&tiledPattern->gy))<0||
-        (e=uhm_chopf32(data,size,cursor,&tiledPattern->ox))<0||
-        (e=uhm_chopf32(data,size,cursor,&tiledPattern->oy))<0||
-        (e=uhm_chop16(data,size,cursor,&tiledPattern->rows))<0||
-        (e=uhm_chop16(data,size,cursor,&tiledPattern->cols))<0
-    ) return e;
-    
-    tiledPattern->instructions.capacity = 0;
-    tiledPattern->instructions.count = 0;
-    tiledPattern->instructions.items = 0;
+char* uhm_encode(char* data, uint32_t size, uint32_t width, uint32_t height){
+    uhm_context context = {0};
+    char* output_data = uhm_context_encode(&context, data, size, width, height);
+    uhm_context_deinit(&context);
+    return output_data;
+}
 
-    while(true){
-        if(*cursor == size){
-                UHM_PRINTF("end clause wasn't found\n");
-                return -1;
-            }
-            uhm_instruction innerInstruction = {0};
-            if((e=uhm_parse_instruction(data,size,cursor,&innerInstruction))<0){
-                UHM_PRINTF("couldn't parse instruction\n");
-                return e;
-            }
+int uhm_encode_into(char* data, uint32_t size, char* out, uint32_t width, uint32_t height, size_t strideBytes){
+    uhm_context context = {0};
+    int e = uhm_context_encode_into(&context, data, size, out, width, height, strideBytes);
+    uhm_context_deinit(&context);
+    return e;
+}
 
-            if(innerInstruction.opcode == 'P' && innerInstruction.skip_draw == true){
-                if(innerInstruction.data) UHM_FREE(innerInstruction.data);
+/*
+    Instructions of whole file parsed once, checked and ready to be drawn any number of times
+    context holds patterns, rendering only reads it so one program can be rendered from many threads at once
+*/
+struct uhm_program{
+    uint32_t backgroundColor;
+    uhm_instructions instructions;
+    uhm_context context;
+    bool flattened;
+    uhm_instances instances; // arrays are one allocation starting at shape
+};
 
-                UHM_PRINTF("you cannot define pattern insde of tiled pattern\n");
+void uhm_program_free_instances(uhm_program* program){
+    if(program->flattened && program->instances.shape != NULL){
+        uhm_allocator allocator = program->context.arena.allocator;
+        allocator.free(allocator.user, program->instances.shape);
+    }
+    memset(&program->instances, 0, sizeof(uhm_instances));
+    program->flattened = false;
+}
+
+/*
+    Shapes get collected by drawing program into target that only collects, so their transforms are exactly ones render would use
+    first pass only counts so arrays are allocated once, collecting stops as soon as there are more than maxInstances shapes
+    or more than UHM_FLATTEN_STEPS tiled cells and pattern placements per allowed shape were walked, so work stays bounded too
+*/
+int64_t uhm_program_flatten(uhm_program* program, size_t maxInstances){
+    uhm_context* context = &program->context;
+    uhm_allocator allocator = context->arena.allocator;
+    uhm_program_free_instances(program);
+    // draw items are indexed with 32 bit ints
+    if(maxInstances > INT32_MAX) maxInstances = INT32_MAX;
+
+    uhm_instances instances = {0};
+    instances.capacity = maxInstances;
+    instances.stepBudget = maxInstances * UHM_FLATTEN_STEPS;
+    uhm_target collect = uhm_make_target(NULL, 1, 1);
+    collect.instances = &instances;
+    for(int pass = 0; pass < 2; pass++){
+        instances.count = 0;
+        instances.steps = 0;
+        for(size_t i = 0; i < program->instructions.count; i++){
+            if(uhm_draw_instruction(context, &program->instructions.items[i], &collect, &uhm_identity_transform) < 0){
+                if(instances.shape != NULL) allocator.free(allocator.user, instances.shape);
                 return -1;
             }
+        }
+        if(pass == 0){
+            size_t count = instances.count;
+            char* block = (char*)allocator.alloc(allocator.user, count * (sizeof(uhm_instruction*) + 9 * sizeof(float) + sizeof(uint32_t) + 1) + 1);
+            if(block == NULL) return -1;
+            instances.shape = (uhm_instruction**)block;
+            float* floats = (float*)(block + count * sizeof(uhm_instruction*));
+            instances.x = floats;
+            instances.y = floats + count;
+            instances.rotation = floats + 2*count;
+            instances.scale = floats + 3*count;
+            instances.cosRotation = floats + 4*count;
+            instances.sinRotation = floats + 5*count;
+            instances.centerX = floats + 6*count;
+            instances.centerY = floats + 7*count;
+            instances.reach = floats + 8*count;
+            instances.order = (uint32_t*)(floats + 9*count);
+            instances.kind = (uint8_t*)(instances.order + count);
+            instances.capacity = count;
+        }
+    }
 
-            if(innerInstruction.skip_draw) continue;
-            if(innerInstruction.opcode == ']') break;
-
-            uhm_append(&tiledPattern->instructions,innerInstruction);
+    for(size_t i = 0; i < instances.count; i++){
+        uhm_bounds bounds;
+        uhm_get_bounds(context, instances.shape[i], &bounds);
+        instances.centerX[i] = instances.x[i] + bounds.x;
+        instances.centerY[i] = instances.y[i] + bounds.y;
+        instances.reach[i] = bounds.near + bounds.far * fabsf(instances.scale[i]);
     }
+    program->instances = instances;
+    program->flattened = true;
+    return (int64_t)instances.count;
+}
 
-    return 0;
+int64_t uhm_program_instance_count(const uhm_program* program){
+    return program->flattened ? (int64_t)program->instances.count : -1;
 }
 
-void uhm_rotate_point(float xIn, float yIn, float angle, float* xOut, float* yOut){
-    *xOut = xIn*cosf(angle) - yIn*sinf(angle);
-    *yOut = xIn*sinf(angle) + yIn*cosf(angle);
+void uhm_program_free(uhm_program* program){
+    if(program == NULL) return;
+    uhm_program_free_instances(program);
+    uhm_context_deinit(&program->context);
+    uhm_allocator allocator = program->context.arena.allocator;
+    allocator.free(allocator.user, program);
 }
 
-int uhm_draw_tiledPattern(uhm_tiledPattern* tiledPattern, uint32_t width, uint32_t height, char* output_data, float gx, float gy, float rotateIN, float scaleIN){
-    float scale = tiledPattern->scale * scaleIN;
-    float rotate = tiledPattern->rotation + rotateIN;
-    
-    int e;
-    float w = tiledPattern->cols;
-    float h = tiledPattern->rows;
+uhm_program* uhm_compile_with_allocator(char* data, uint32_t size, uhm_allocator allocator){
+    UHM_PRINTF("Got %u bytes\n", size);
+    if(allocator.alloc == NULL){
+        allocator.alloc = uhm_default_alloc;
+        allocator.free = uhm_default_free;
+    }
+    uhm_program* program = (uhm_program*)allocator.alloc(allocator.user, sizeof(uhm_program));
+    if(program == NULL) return NULL;
+    memset(program, 0, sizeof(uhm_program));
+    program->context.arena.allocator = allocator;
 
-    float scaledW, scaledH;
+    uint32_t cursor = 0;
+    int e;
+    if((e=uhm_parse_header(&program->context, data,size,&cursor,&program->backgroundColor))<0){
+        uhm_program_free(program);
+        return NULL;
+    }
 
-    if(scale != 1){
-        scaledW = w * scale;
-        scaledH = h * scale;
+    while(cursor < size){
+        uhm_instruction instruction = {0};
+        bool hasCircle = false;
+        if(
+            (e=uhm_parse_instruction(&program->context, data,size,&cursor,&instruction))<0||
+            (!instruction.skip_draw && (e=uhm_validate_instruction(&program->context, &instruction, &hasCircle))<0)
+        ){
+            uhm_program_free(program);
+            return NULL;
+        }
+        if(instruction.skip_draw) continue;
+        if(uhm_arena_append(&program->context.arena, &program->instructions, instruction) < 0){
+            UHM_PRINTF("out of memory\n");
+            uhm_program_free(program);
+            return NULL;
+        }
     }
 
-    for(int i = 0; i < tiledPattern->rows; i++){
-        for(int j = 0; j < tiledPattern->cols; j++){
-            for(int index = 0; index < tiledPattern->instructions.count; index++){
-                if(tiledPattern->instructions.items[index].skip_draw) continue;
+    // modifiers at the end of file have nothing to apply to
+    program->context.rotateModifierActive = false;
+    program->context.scaleModifierActive = false;
 
-                float outX, outY;
-                if(rotate == 0){
-                    outX = tiledPattern->ox*scale*j;
-                    outY = tiledPattern->oy*scale*i;
-                }
-                else{
-                    float rotateX,rotateY;
+    // program too big to flatten still renders, just through its patterns
+    uhm_program_flatten(program, UHM_MAX_INSTANCES);
+    return program;
+}
 
-                    uhm_rotate_point((float)j - w/4, i - h/4, -rotate, &rotateX, &rotateY);
+uint32_t uhm_program_background_color(const uhm_program* program){
+    return program->backgroundColor;
+}
 
-                    outX = tiledPattern->ox*scale*(rotateX + w/4);
-                    outY = tiledPattern->oy*scale*(rotateY + h/4);
-                }
+uhm_program* uhm_compile(char* data, uint32_t size){
+    uhm_allocator allocator = {0};
+    return uhm_compile_with_allocator(data, size, allocator);
+}
 
-                if(scale != 1){
-                    float diffX = scaledW/4 - w/4;
-                    float diffY = scaledH/4 - h/4;
+/*
+    Renders draw items of program, shapes of its instances when it's flattened and its instructions otherwise
+*/
+size_t uhm_program_item_count(const uhm_program* program){
+    return program->flattened ? program->instances.count : program->instructions.count;
+}
 
-                    outX -= tiledPattern->ox*diffX;
-                    outY -= tiledPattern->oy*diffY;
-                }
+/*
+    Pixel center and reach of instance at this canvas size
+*/
+void uhm_instance_reach(const uhm_instances* instances, size_t i, uint32_t width, uint32_t height, double* centerX, double* centerY, double* reach){
+    double size = width > height ? width : height;
+    *centerX = (double)instances->centerX[i] * width;
+    *centerY = (double)instances->centerY[i] * (instances->kind[i] == 'C' ? width : height);
+    *reach = (double)instances->reach[i] * size;
+}
 
-                outX += gx + tiledPattern->gx;
-                outY += gy + tiledPattern->gy;
+int uhm_draw_item(const uhm_program* program, size_t item, uhm_target* target){
+    uhm_context* context = (uhm_context*)&program->context;
+    if(!program->flattened) return uhm_draw_instruction(context, &program->instructions.items[item], target, &uhm_identity_transform);
+
+    const uhm_instances* instances = &program->instances;
+    double centerX, centerY, reach;
+    uhm_instance_reach(instances, item, target->width, target->height, &centerX, &centerY, &reach);
+    if(uhm_target_misses(target, centerX, centerY, reach)) return 0;
+    uhm_transform transform = {
+        instances->x[item], instances->y[item], instances->rotation[item], instances->scale[item],
+        instances->cosRotation[item], instances->sinRotation[item]
+    };
+    return uhm_draw_instruction(context, instances->shape[item], target, &transform);
+}
 
-                if((e=uhm_draw_instruction(&tiledPattern->instructions.items[index],width,height,output_data,outX,outY, rotate, scale))<0) return e;
-            }
+/*
+    Background and every instruction of program drawn into target
+*/
+int uhm_render_target(const uhm_program* program, uhm_target* target){
+    uhm_context* context = (uhm_context*)&program->context;
+    uhm_target_fill(target, program->backgroundColor);
+    int e;
+    // sprites are cached per pattern, so cached render keeps drawing through patterns
+    if(target->sprites != NULL){
+        for(size_t i = 0; i < program->instructions.count; i++){
+            if((e=uhm_draw_instruction(context, &program->instructions.items[i], target, &uhm_identity_transform))<0) return e;
         }
+        return 0;
+    }
+    for(size_t i = 0; i < uhm_program_item_count(program); i++){
+        if((e=uhm_draw_item(program, i, target))<0) return e;
     }
     return 0;
 }
 
-typedef struct {
-    uint16_t patternID;
-    uhm_instructions instructions;
-} uhm_pattern;
+int uhm_render_cached(const uhm_program* program, uint32_t width, uint32_t height, char* out, uhm_sprite_cache* cache){
+    uhm_target target = uhm_make_target(out, width, height);
+    target.sprites = cache;
+    return uhm_render_target(program, &target);
+}
 
-typedef struct {
-    uint16_t patternID;
-    float x;
-    float y;
-    float rotation;
-    float scale;
-} uhm_place_pattern;
+int uhm_render(const uhm_program* program, uint32_t width, uint32_t height, char* out){
+    return uhm_render_cached(program, width, height, out, NULL);
+}
 
-typedef struct {
-    uhm_pattern* items;
-    size_t       count;
-    size_t       capacity;
-} uhm_patterns;
+int uhm_render_into(const uhm_program* program, uint32_t width, uint32_t height, char* out, size_t strideBytes){
+    uhm_target target;
+    if(!uhm_make_strided_target(out, width, height, strideBytes, &target)) return -1;
+    return uhm_render_target(program, &target);
+}
 
-uhm_patterns patterns = {0};
+int uhm_render_region(const uhm_program* program, uint32_t virtualWidth, uint32_t virtualHeight, uint32_t x0, uint32_t y0, uint32_t width, uint32_t height, char* out){
+    if(virtualWidth > INT32_MAX || virtualHeight > INT32_MAX || (uint64_t)x0 + width > INT32_MAX || (uint64_t)y0 + height > INT32_MAX){
+        UHM_PRINTF("region doesn't fit 32 bit pixel coordinates\n");
+        return -1;
+    }
+    // region is window into virtual canvas, whole window gets background but only part on canvas gets shapes
+    uhm_target target = uhm_make_target(out, virtualWidth, virtualHeight);
+    target.originX = target.clip.x0 = x0;
+    target.originY = target.clip.y0 = y0;
+    target.clip.x1 = x0 + width;
+    target.clip.y1 = y0 + height;
+    target.stride = width;
+    uhm_target_fill(&target, program->backgroundColor);
+
+    if(target.clip.x1 > (int32_t)virtualWidth) target.clip.x1 = virtualWidth;
+    if(target.clip.y1 > (int32_t)virtualHeight) target.clip.y1 = virtualHeight;
+    if(target.clip.x0 >= target.clip.x1 || target.clip.y0 >= target.clip.y1) return 0;
 
-int uhm_parse_pattern(char* data, uint32_t size, uint32_t* cursor, uhm_instruction* instruction){
     int e;
-    uint8_t mode;
-    uint16_t patternID;
-    if(
-        (e=uhm_chop8(data,size,cursor,&mode))<0||
-        (e=uhm_chop16(data,size,cursor,&patternID))<0
-    ) return e;
-
-    if(mode == 'P'){
-        float x,y;
-        if(
-            (e=uhm_chopf32(data,size,cursor,&x))<0||
-            (e=uhm_chopf32(data,size,cursor,&y))<0
-        ) return e;
-        instruction->data = UHM_MALLOC(sizeof(uhm_place_pattern));
-        ((uhm_place_pattern*)(instruction->data))->patternID = patternID;
-        ((uhm_place_pattern*)(instruction->data))->x = x;
-        ((uhm_place_pattern*)(instruction->data))->y = y;
-        ((uhm_place_pattern*)(instruction->data))->rotation = 0;
-        if(uhm_rotateModifierActive){
-            ((uhm_place_pattern*)(instruction->data))->rotation = uhm_rotateModifierVal;
-            uhm_rotateModifierActive = false;
-        }
-        if(uhm_scaleModifierActive){
-            ((uhm_place_pattern*)(instruction->data))->scale = uhm_scaleModifierVal;
-            uhm_scaleModifierActive = false;
-        }else{
-            ((uhm_place_pattern*)(instruction->data))->scale = 1.0f;
-        }
-        return 0;
+    for(size_t i = 0; i < uhm_program_item_count(program); i++){
+        if((e=uhm_draw_item(program, i, &target))<0) return e;
     }
-    else if(mode == 'R'){
-        instruction->skip_draw = true;
-        uhm_pattern pattern = {0};
-        pattern.patternID = patternID;
+    return 0;
+}
 
-        while(true){
-            if(*cursor == size){
-                UHM_PRINTF("end clause wasn't found\n");
-                return -1;
-            }
-            uhm_instruction innerInstruction = {0};
-            if((e=uhm_parse_instruction(data,size,cursor,&innerInstruction))<0){
-                UHM_PRINTF("couldn't parse instruction\n");
-                if(instruction->data) UHM_FREE(instruction->data);
-                return e;
-            }
+typedef struct {
+    void (*fn)(void* arg);
+    void* arg;
+} uhm_thread_task;
 
-            if(innerInstruction.opcode == 'P' && innerInstruction.skip_draw == true){
-                if(innerInstruction.data) UHM_FREE(innerInstruction.data);
-                if(instruction->data) UHM_FREE(instruction->data);
+#if !defined(UHM_NO_THREADS)
+#   if defined(_WIN32)
+typedef HANDLE uhm_thread;
 
-                UHM_PRINTF("you cannot define pattern insde of defining pattern\n");
-                return -1;
-            }
+DWORD WINAPI uhm_thread_entry(LPVOID param){
+    uhm_thread_task* task = (uhm_thread_task*)param;
+    task->fn(task->arg);
+    return 0;
+}
 
-            if(innerInstruction.skip_draw) continue;
-            if(innerInstruction.opcode == ']') break;
+bool uhm_thread_start(uhm_thread* thread, uhm_thread_task* task){
+    *thread = CreateThread(NULL, 0, uhm_thread_entry, task, 0, NULL);
+    return *thread != NULL;
+}
 
-            uhm_append(&pattern.instructions,innerInstruction);
-        }
+void uhm_thread_join(uhm_thread thread){
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
 
-        uhm_append(&patterns, pattern);
-        return 0;
-    }
-    return -1;
+uint32_t uhm_cpu_count(void){
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
 }
+#   else
+typedef pthread_t uhm_thread;
 
-int uhm_parse_rotateModifier(char* data, uint32_t size, uint32_t* cursor, uhm_instruction* instruction){
-    instruction->skip_draw = true;
-    int e;
-    float intermediate;
-    if((e=uhm_chopf32(data,size,cursor,&intermediate))<0) return e;
-    if(uhm_rotateModifierActive){
-        uhm_rotateModifierVal += intermediate;
-    }else{
-        uhm_rotateModifierVal = intermediate;
-    }
-    uhm_rotateModifierActive = true;
-    return 0;
+void* uhm_thread_entry(void* param){
+    uhm_thread_task* task = (uhm_thread_task*)param;
+    task->fn(task->arg);
+    return NULL;
 }
 
-int uhm_parse_scaleModifier(char* data, uint32_t size, uint32_t* cursor, uhm_instruction* instruction){
-    instruction->skip_draw = true;
-    int e;
-    float intermediate;
-    if((e=uhm_chopf32(data,size,cursor,&intermediate))<0) return e;
-    if(uhm_scaleModifierActive){
-        uhm_scaleModifierVal *= intermediate;
-    }else{
-        uhm_scaleModifierVal = intermediate;
-    }
-    uhm_scaleModifierActive = true;
-    return 0;
+bool uhm_thread_start(uhm_thread* thread, uhm_thread_task* task){
+    return pthread_create(thread, NULL, uhm_thread_entry, task) == 0;
 }
 
-int uhm_parse_instruction(char* data, uint32_t size, uint32_t* cursor, uhm_instruction* instruction){
-    int e;
-    uint8_t opcode;
-    if((e=uhm_chop8(data,size,cursor,&opcode))<0) return e;
+void uhm_thread_join(uhm_thread thread){
+    pthread_join(thread, NULL);
+}
 
-    instruction->opcode = opcode;
+uint32_t uhm_cpu_count(void){
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (uint32_t)count : 1;
+}
+#   endif
+#else
+uint32_t uhm_cpu_count(void){
+    return 1;
+}
+#endif
 
-    if(opcode == 'R'){
-        uhm_rectangle rectangle = {0};
-        if((e=uhm_parse_rectangle(&rectangle, data,size,cursor))<0) return e;
-        instruction->data = UHM_MALLOC(sizeof(uhm_rectangle));
-        *(uhm_rectangle*)(instruction->data) = rectangle;
-        return 0;
-    }
-    else if(opcode == 'C'){
-        uhm_circle circle = {0};
-        if((e=uhm_parse_circle(&circle, data,size,cursor))<0) return e;
-        instruction->data = UHM_MALLOC(sizeof(uhm_circle));
-        *(uhm_circle*)(instruction->data) = circle;
-        return 0;
-    }
-    else if(opcode == 'E'){
-        uhm_ellipse ellipse = {0};
-        if((e=uhm_parse_ellipse(&ellipse, data,size,cursor))<0) return e;
-        instruction->data = UHM_MALLOC(sizeof(uhm_ellipse));
-        *(uhm_ellipse*)(instruction->data) = ellipse;
-        return 0;
-    }
-    else if(opcode == 'T'){
-        uhm_tiledPattern tiledPattern = {0};
-        if((e=uhm_parse_tiledPattern(&tiledPattern, data,size,cursor))<0) {
-            if(tiledPattern.instructions.items != NULL) UHM_FREE(tiledPattern.instructions.items);
-            return e;
-        }
-        instruction->data = UHM_MALLOC(sizeof(uhm_tiledPattern));
-        *(uhm_tiledPattern*)(instruction->data) = tiledPattern;
-        return 0;
-    }
-    else if(opcode == 'P'){
-        return uhm_parse_pattern(data,size,cursor,instruction);
-    }
-    else if(opcode == '|'){
-        return uhm_parse_rotateModifier(data,size,cursor,instruction);
-    }
-    else if(opcode == '\\'){
-        return uhm_parse_scaleModifier(data,size,cursor,instruction);
-    }
-    else if(opcode == ']'){
-        return 0;
+/*
+    Runs fn(arg) on threadCount threads including the calling one and waits for all of them
+    fn is expected to pull work from shared counter, so threads that fail to start just leave their share to the others
+*/
+void uhm_run_parallel(uint32_t threadCount, void (*fn)(void* arg), void* arg){
+    uhm_thread_task task = {fn, arg};
+#if !defined(UHM_NO_THREADS)
+    uint32_t started = 0;
+    uhm_thread* threads = NULL;
+    if(threadCount > 1){
+        threads = (uhm_thread*)UHM_MALLOC(sizeof(uhm_thread) * (threadCount - 1));
+        while(threads != NULL && started < threadCount - 1 && uhm_thread_start(&threads[started], &task)) started++;
     }
+    task.fn(task.arg);
+    for(uint32_t i = 0; i < started; i++) uhm_thread_join(threads[i]);
+    if(threads != NULL) UHM_FREE(threads);
+#else
+    task.fn(task.arg);
+#endif
+}
 
-    UHM_PRINTF("Parse: Unknown Opcode: %c\n", opcode);
-    return -1;
-};
-
-int uhm_draw_placePattern(uhm_place_pattern* patternDesc, uint32_t width, uint32_t height, char* output_data, float gx, float gy, float rotateIN, float scaleIN){
-    float scale = patternDesc->scale * scaleIN;
-    float rotate = patternDesc->rotation + rotateIN;
-    
-    uhm_pattern* pattern = NULL;
-    int e;
-    for(int i = 0; i < patterns.count; i++){
-        if(patterns.items[i].patternID == patternDesc->patternID){
-            pattern = &patterns.items[i];
-            break;
+/*
+    Screen space box of every draw item of program at this size, NULL when drawing fails or out of memory
+    instances get box of their reach without drawing anything
+    instructions that gave up measuring cover whole canvas, ones drawing nothing have empty box
+*/
+uhm_box* uhm_measure_program(const uhm_program* program, uint32_t width, uint32_t height){
+    size_t count = uhm_program_item_count(program);
+    uhm_box* bounds = (uhm_box*)UHM_MALLOC((count + 1) * sizeof(uhm_box));
+    if(bounds == NULL) return NULL;
+    for(size_t i = 0; i < count; i++){
+        uhm_target measure = uhm_make_target(NULL, width, height);
+        if(program->flattened){
+            double centerX, centerY, reach;
+            uhm_instance_reach(&program->instances, i, width, height, &centerX, &centerY, &reach);
+            bounds[i] = uhm_target_reach_box(&measure, centerX, centerY, reach);
+            continue;
         }
+        uhm_target_start_measure(&measure);
+        if(uhm_draw_item(program, i, &measure) < 0){
+            UHM_FREE(bounds);
+            return NULL;
+        }
+        if(measure.measureBudget <= 0){
+            measure.bounds.x0 = measure.bounds.y0 = 0;
+            measure.bounds.x1 = width;
+            measure.bounds.y1 = height;
+        }
+        bounds[i] = measure.bounds;
     }
-    if(pattern == NULL){
-        UHM_PRINTF("Unknown patternID %d\n",patternDesc->patternID);
-        return -1;
-    }
+    return bounds;
+}
 
-    float realX = patternDesc->x + gx;
-    float realY = patternDesc->y + gy;
+/*
+    Instructions binned into tiles, tileStart[tile] .. tileStart[tile + 1] are indices into tileItems
+*/
+typedef struct {
+    const uhm_program* program;
+    size_t* tileStart;
+    uint32_t* tileItems;
+    uint32_t tilesX, tilesY;
 
-    for(int i = 0; i < pattern->instructions.count; i++){
-        if(pattern->instructions.items[i].skip_draw) continue;
-        float outX, outY;
-        float localX, localY;
-        float scaledLocalX, scaledLocalY;
+    char* output_data;
+    uint32_t width, height;
 
-        if(rotate != 0 || scale != 1) {
-            if((e=uhm_get_location(&pattern->instructions.items[i],&localX,&localY))<0) return e;
-            scaledLocalX = localX;
-            scaledLocalY = localY;
-            if(scale != 1){
-                scaledLocalX *= scale;
-                scaledLocalY *= scale;
-            }
-        }
+    volatile int32_t nextTile;
+    volatile int32_t failed;
+} uhm_tile_job;
 
-        if(rotate == 0){
-            outX = realX;
-            outY = realY;
-        }else{
-            float rotatedX = (scaledLocalX * cosf(-rotate) - scaledLocalY *sinf(-rotate));
-            float rotatedY = (scaledLocalX * sinf(-rotate) + scaledLocalY *cosf(-rotate));
+void uhm_render_tiles(void* arg){
+    uhm_tile_job* job = (uhm_tile_job*)arg;
+    int32_t tileCount = job->tilesX * job->tilesY;
+    while(true){
+        int32_t tile = uhm_atomic_add(&job->nextTile, 1);
+        if(tile >= tileCount || job->failed) return;
 
-            outX = realX + (rotatedX - scaledLocalX);
-            outY = realY + (rotatedY - scaledLocalY);
+        uhm_target target = uhm_make_target(job->output_data, job->width, job->height);
+        target.clip.x0 = (tile % job->tilesX) * UHM_TILE_SIZE;
+        target.clip.y0 = (tile / job->tilesX) * UHM_TILE_SIZE;
+        target.clip.x1 = target.clip.x0 + UHM_TILE_SIZE < (int32_t)job->width ? target.clip.x0 + UHM_TILE_SIZE : (int32_t)job->width;
+        target.clip.y1 = target.clip.y0 + UHM_TILE_SIZE < (int32_t)job->height ? target.clip.y0 + UHM_TILE_SIZE : (int32_t)job->height;
 
+        for(int32_t i = target.clip.y0; i < target.clip.y1; i++){
+            uhm_fill_color((uint32_t*)job->output_data + (size_t)i*job->width + target.clip.x0, job->program->backgroundColor, target.clip.x1 - target.clip.x0);
         }
 
-        if(scale != 1){
-            float diffX = scaledLocalX - localX;
-            float diffY = scaledLocalY - localY;
-
-            outX += diffX;
-            outY += diffY;
+        for(size_t k = job->tileStart[tile]; k < job->tileStart[tile + 1]; k++){
+            if(uhm_draw_item(job->program, job->tileItems[k], &target) < 0){
+                uhm_atomic_add(&job->failed, 1);
+                return;
+            }
         }
-
-        if((e=uhm_draw_instruction(&pattern->instructions.items[i],width,height,output_data,outX,outY, rotate, scale))<0) return e;
     }
-    return 0;
 }
 
-int uhm_get_location(uhm_instruction* instruction, float* out_x, float* out_y){
-    int e;
-    if(instruction->opcode == 'R'){
-        *out_x = ((uhm_rectangle*)instruction->data)->x;
-        *out_y = ((uhm_rectangle*)instruction->data)->y;
+int uhm_render_parallel(const uhm_program* program, uint32_t width, uint32_t height, char* out, uint32_t threadCount){
+    if(threadCount == 0) threadCount = uhm_cpu_count();
+    size_t count = uhm_program_item_count(program);
+
+    // bounds of every draw item at this size, empty ones don't go into any tile
+    uhm_box* bounds = uhm_measure_program(program, width, height);
+    if(bounds == NULL) return -1;
+
+    uhm_tile_job job = {0};
+    job.program = program;
+    job.tilesX = (width + UHM_TILE_SIZE - 1) / UHM_TILE_SIZE;
+    job.tilesY = (height + UHM_TILE_SIZE - 1) / UHM_TILE_SIZE;
+    job.output_data = out;
+    job.width = width;
+    job.height = height;
+
+    // two passes over bounds, first counts instructions per tile and second fills them in order
+    size_t tileCount = (size_t)job.tilesX * job.tilesY;
+    job.tileStart = (size_t*)UHM_MALLOC((tileCount + 1) * sizeof(size_t));
+    if(job.tileStart == NULL){
+        UHM_FREE(bounds);
+        return -1;
+    }
+    memset(job.tileStart, 0, (tileCount + 1) * sizeof(size_t));
+    for(size_t i = 0; i < count; i++){
+        if(bounds[i].x0 >= bounds[i].x1 || bounds[i].y0 >= bounds[i].y1) continue;
+        for(int32_t ty = bounds[i].y0 / UHM_TILE_SIZE; ty <= (bounds[i].y1 - 1) / UHM_TILE_SIZE; ty++){
+            for(int32_t tx = bounds[i].x0 / UHM_TILE_SIZE; tx <= (bounds[i].x1 - 1) / UHM_TILE_SIZE; tx++){
+                job.tileStart[(size_t)ty*job.tilesX + tx + 1]++;
+            }
+        }
     }
-    else if(instruction->opcode == 'C'){
-        *out_x = ((uhm_circle*)instruction->data)->x;
-        *out_y = ((uhm_circle*)instruction->data)->y;
+    for(size_t i = 0; i < tileCount; i++) job.tileStart[i + 1] += job.tileStart[i];
+
+    size_t* fill = (size_t*)UHM_MALLOC((tileCount + 1) * sizeof(size_t));
+    job.tileItems = (uint32_t*)UHM_MALLOC((job.tileStart[tileCount] + 1) * sizeof(uint32_t));
+    if(fill == NULL || job.tileItems == NULL){
+        if(fill != NULL) UHM_FREE(fill);
+        if(job.tileItems != NULL) UHM_FREE(job.tileItems);
+        UHM_FREE(job.tileStart);
+        UHM_FREE(bounds);
+        return -1;
     }
-    else if(instruction->opcode == 'E'){
-        *out_x = ((uhm_ellipse*)instruction->data)->x;
-        *out_y = ((uhm_ellipse*)instruction->data)->y;
+    memcpy(fill, job.tileStart, (tileCount + 1) * sizeof(size_t));
+    for(size_t i = 0; i < count; i++){
+        if(bounds[i].x0 >= bounds[i].x1 || bounds[i].y0 >= bounds[i].y1) continue;
+        for(int32_t ty = bounds[i].y0 / UHM_TILE_SIZE; ty <= (bounds[i].y1 - 1) / UHM_TILE_SIZE; ty++){
+            for(int32_t tx = bounds[i].x0 / UHM_TILE_SIZE; tx <= (bounds[i].x1 - 1) / UHM_TILE_SIZE; tx++){
+                job.tileItems[fill[(size_t)ty*job.tilesX + tx]++] = (uint32_t)i;
+            }
+        }
     }
-    else if(instruction->opcode == 'T'){
-        *out_x = ((uhm_tiledPattern*)instruction->data)->ox;
-        *out_y = ((uhm_tiledPattern*)instruction->data)->oy;
+    UHM_FREE(fill);
+    UHM_FREE(bounds);
+
+    uhm_get_kernels();
+    if(tileCount > 0) uhm_run_parallel(threadCount < tileCount ? threadCount : (uint32_t)tileCount, uhm_render_tiles, &job);
+
+    UHM_FREE(job.tileStart);
+    UHM_FREE(job.tileItems);
+    return job.failed ? -1 : 0;
+}
+
+/*
+    Threads of uhm_render_indexed first take instructions one at a time, then bands of rows to turn index buffer into colors
+*/
+typedef struct {
+    const uhm_program* program;
+    volatile uint64_t* indexBuffer;
+    char* output_data;
+    uint32_t width, height;
+
+    volatile int32_t nextInstruction;
+    volatile int32_t nextRows;
+    volatile int32_t failed;
+} uhm_indexed_job;
+
+void uhm_render_indexed_instructions(void* arg){
+    uhm_indexed_job* job = (uhm_indexed_job*)arg;
+    size_t count = uhm_program_item_count(job->program);
+    uint32_t* scratch = (uint32_t*)UHM_MALLOC((size_t)job->width * 4);
+    if(scratch == NULL){
+        uhm_atomic_add(&job->failed, 1);
+        return;
     }
-    else if(instruction->opcode == 'P'){
-        *out_x = ((uhm_place_pattern*)instruction->data)->x;
-        *out_y = ((uhm_place_pattern*)instruction->data)->y;
+
+    uhm_target target = uhm_make_target(NULL, job->width, job->height);
+    target.indexBuffer = job->indexBuffer;
+    target.scratch = scratch;
+    while(!job->failed){
+        // last instructions go first, so earlier ones mostly find their pixels taken and skip coloring them
+        int32_t taken = uhm_atomic_add(&job->nextInstruction, 1);
+        if(taken < 0 || (size_t)taken >= count) break;
+        int32_t index = (int32_t)count - 1 - taken;
+        target.index = index;
+        if(uhm_draw_item(job->program, index, &target) < 0){
+            uhm_atomic_add(&job->failed, 1);
+            break;
+        }
     }
-    else{
-        UHM_PRINTF("GetInstructionLocation: Unknown Opcode %c\n", instruction->opcode);
-        return -1;
+    UHM_FREE(scratch);
+}
+
+void uhm_resolve_indexed_rows(void* arg){
+    uhm_indexed_job* job = (uhm_indexed_job*)arg;
+    while(true){
+        int32_t row0 = uhm_atomic_add(&job->nextRows, UHM_TILE_SIZE);
+        if(row0 >= (int32_t)job->height) return;
+        int32_t row1 = row0 + UHM_TILE_SIZE < (int32_t)job->height ? row0 + UHM_TILE_SIZE : (int32_t)job->height;
+        for(size_t i = (size_t)row0 * job->width; i < (size_t)row1 * job->width; i++){
+            uint64_t value = job->indexBuffer[i];
+            ((uint32_t*)job->output_data)[i] = value != 0 ? (uint32_t)value : job->program->backgroundColor;
+        }
     }
-    return 0;
 }
 
-int uhm_draw_instruction(uhm_instruction* instruction, uint32_t width, uint32_t height, char* output_data, float gx, float gy, float rotation, float scale){
-    int e;
-         if(instruction->opcode == 'R') {if((e=uhm_draw_rectangle((uhm_rectangle*)instruction->data,width,height,output_data, gx, gy, rotation, scale))<0) return e;}
-    else if(instruction->opcode == 'C') {if((e=uhm_draw_circle((uhm_circle*)instruction->data,width,height,output_data, gx, gy, rotation, scale))<0) return e;}
-    else if(instruction->opcode == 'E') {if((e=uhm_draw_ellipse((uhm_ellipse*)instruction->data,width,height,output_data, gx, gy, rotation, scale))<0) return e;}
-    else if(instruction->opcode == 'T') {if((e=uhm_draw_tiledPattern((uhm_tiledPattern*)instruction->data,width,height,output_data, gx, gy, rotation, scale))<0) return e;}
-    else if(instruction->opcode == 'P') {if((e=uhm_draw_placePattern((uhm_place_pattern*)instruction->data,width,height,output_data, gx, gy, rotation, scale))<0) return e;}
-    else{
-        UHM_PRINTF("Draw: Unknown Opcode %c\n", instruction->opcode);
-        return -1; 
+int uhm_render_indexed(const uhm_program* program, uint32_t width, uint32_t height, char* out, uint32_t threadCount){
+    if(threadCount == 0) threadCount = uhm_cpu_count();
+    size_t count = uhm_program_item_count(program);
+    if(count > INT32_MAX || height > INT32_MAX - UHM_TILE_SIZE){
+        UHM_PRINTF("too many instructions or rows for indexed render\n");
+        return -1;
     }
-    return 0;
+
+    // 0 means no instruction drew pixel
+    uint64_t* indexBuffer = (uint64_t*)UHM_MALLOC((size_t)width * height * 8 + 8);
+    if(indexBuffer == NULL) return -1;
+    memset(indexBuffer, 0, (size_t)width * height * 8);
+
+    uhm_indexed_job job = {0};
+    job.program = program;
+    job.indexBuffer = indexBuffer;
+    job.output_data = out;
+    job.width = width;
+    job.height = height;
+
+    uhm_get_kernels();
+    uint32_t drawThreads = threadCount < count ? threadCount : (uint32_t)count;
+    if(drawThreads > 0) uhm_run_parallel(drawThreads, uhm_render_indexed_instructions, &job);
+    if(!job.failed) uhm_run_parallel(threadCount, uhm_resolve_indexed_rows, &job);
+
+    UHM_FREE(indexBuffer);
+    return job.failed ? -1 : 0;
 }
 
-char* uhm_encode(char* data, uint32_t size, uint32_t width, uint32_t height){
-    UHM_PRINTF("Got %u bytes\n", size);
-    char* output_data = (char*)UHM_MALLOC(width*height*4);
-    uint32_t cursor = 0;
+int uhm_render_occluded(const uhm_program* program, uint32_t width, uint32_t height, char* out){
+    size_t words = ((size_t)width + 63) / 64;
+    uint64_t* covered = (uint64_t*)UHM_MALLOC(words * height * 8 + 8);
+    if(covered == NULL) return -1;
+    memset(covered, 0, words * height * 8);
+
+    uhm_boxes pending = {0};
+    uhm_target target = uhm_make_target(out, width, height);
+    target.covered = covered;
+    target.coveredWords = words;
+    target.pending = &pending;
+
+    // pixels written by instruction become final only after whole instruction, its own shapes still overwrite each other in order
+    uint64_t coveredCount = 0;
+    int e = 0;
+    for(size_t i = uhm_program_item_count(program); i-- > 0 && coveredCount < (uint64_t)width * height;){
+        if((e=uhm_draw_item(program, i, &target))<0) break;
+        for(size_t k = 0; k < pending.count; k++){
+            coveredCount += uhm_set_bits(covered + (size_t)pending.items[k].y0 * words, pending.items[k].x0, pending.items[k].x1);
+        }
+        pending.count = 0;
+    }
 
-    if(patterns.count > 0){
-        for(int i = 0; i < patterns.count; i++){
-            if(patterns.items[i].instructions.items != NULL) UHM_FREE(patterns.items[i].instructions.items);
+    for(uint32_t row = 0; row < height && e >= 0; row++){
+        const uint64_t* bits = covered + (size_t)row * words;
+        int32_t at = 0;
+        while(at < (int32_t)width){
+            int32_t runStart = uhm_find_bit(bits, at, width, false);
+            if(runStart == (int32_t)width) break;
+            int32_t runEnd = uhm_find_bit(bits, runStart, width, true);
+            uhm_fill_color((uint32_t*)out + (size_t)row * width + runStart, program->backgroundColor, runEnd - runStart);
+            at = runEnd;
         }
     }
 
-    patterns.count = 0;
+    if(pending.items != NULL) UHM_FREE(pending.items);
+    UHM_FREE(covered);
+    return e < 0 ? e : 0;
+}
+
+char* uhm_encode_parallel(char* data, uint32_t size, uint32_t width, uint32_t height, uint32_t threadCount){
+    uhm_program* program = uhm_compile(data, size);
+    if(program == NULL) return NULL;
 
-    if(!uhm_expect(data,size,cursor,'U')) {
+    char* output_data = (char*)UHM_MALLOC((size_t)width*height*4);
+    if(output_data != NULL && uhm_render_parallel(program, width, height, output_data, threadCount) < 0){
         UHM_FREE(output_data);
-        return NULL;
+        output_data = NULL;
     }
-    cursor++;
-    if(!uhm_expect(data,size,cursor,'H')) {
-        UHM_FREE(output_data);
-        return NULL;
+    uhm_program_free(program);
+    return output_data;
+}
+
+int uhm_render_banded(const uhm_program* program, uint32_t width, uint32_t height, uint32_t bandHeight, uhm_band_fn onBand, void* user){
+    if(bandHeight == 0) bandHeight = UHM_BAND_HEIGHT;
+    if(bandHeight > height) bandHeight = height;
+    if(width == 0 || height == 0) return 0;
+    size_t count = uhm_program_item_count(program);
+    size_t bandCount = ((size_t)height + bandHeight - 1) / bandHeight;
+
+    uhm_box* bounds = uhm_measure_program(program, width, height);
+    if(bounds == NULL) return -1;
+
+    // two passes over bounds like tiles of uhm_render_parallel, instructions of band are bandItems[bandStart[band] .. bandStart[band + 1]]
+    size_t* bandStart = (size_t*)UHM_MALLOC((bandCount + 1) * sizeof(size_t));
+    char* band = (char*)UHM_MALLOC((size_t)width * bandHeight * 4);
+    if(bandStart == NULL || band == NULL){
+        if(bandStart != NULL) UHM_FREE(bandStart);
+        if(band != NULL) UHM_FREE(band);
+        UHM_FREE(bounds);
+        return -1;
     }
-    cursor++;
-    if(!uhm_expect(data,size,cursor,'M')) {
-        UHM_FREE(output_data);
-        return NULL;
+    memset(bandStart, 0, (bandCount + 1) * sizeof(size_t));
+    for(size_t i = 0; i < count; i++){
+        if(bounds[i].x0 >= bounds[i].x1 || bounds[i].y0 >= bounds[i].y1) continue;
+        for(size_t b = bounds[i].y0 / bandHeight; b <= (size_t)(bounds[i].y1 - 1) / bandHeight; b++) bandStart[b + 1]++;
     }
-    cursor++;
-    UHM_PRINTF("File Verified\n");
-
-    // setting image background color
-    uint32_t backgroundColor;
-    int e;
-    if((e=uhm_chop32(data,size,&cursor,&backgroundColor))<0) return NULL;
-    for(int i = 0; i < width * height; i++) ((uint32_t*)output_data)[i] = backgroundColor;
-
-    uhm_instruction instruction = {0};
-    while(cursor < size){
-        instruction = {0};
-        if((e=uhm_parse_instruction(data,size,&cursor,&instruction))<0) {
-            UHM_FREE(output_data);
-            if(instruction.data) UHM_FREE(instruction.data);
-            if(instruction.opcode == 'T' && instruction.data != NULL) UHM_FREE(((uhm_tiledPattern*)instruction.data)->instructions.items);
-            return NULL;
-        }
-
-        if(!instruction.skip_draw){
-            if((e=uhm_draw_instruction(&instruction,width,height,output_data, 0, 0, 0, 1))<0) {
-                UHM_FREE(output_data);
-                if(instruction.data) UHM_FREE(instruction.data);
-                if(instruction.opcode == 'T' && instruction.data != NULL) UHM_FREE(((uhm_tiledPattern*)instruction.data)->instructions.items);
-                return NULL;
-            }
+    for(size_t b = 0; b < bandCount; b++) bandStart[b + 1] += bandStart[b];
+
+    size_t* fill = (size_t*)UHM_MALLOC((bandCount + 1) * sizeof(size_t));
+    uint32_t* bandItems = (uint32_t*)UHM_MALLOC((bandStart[bandCount] + 1) * sizeof(uint32_t));
+    if(fill == NULL || bandItems == NULL){
+        if(fill != NULL) UHM_FREE(fill);
+        if(bandItems != NULL) UHM_FREE(bandItems);
+        UHM_FREE(bandStart);
+        UHM_FREE(band);
+        UHM_FREE(bounds);
+        return -1;
+    }
+    memcpy(fill, bandStart, (bandCount + 1) * sizeof(size_t));
+    for(size_t i = 0; i < count; i++){
+        if(bounds[i].x0 >= bounds[i].x1 || bounds[i].y0 >= bounds[i].y1) continue;
+        for(size_t b = bounds[i].y0 / bandHeight; b <= (size_t)(bounds[i].y1 - 1) / bandHeight; b++) bandItems[fill[b]++] = (uint32_t)i;
+    }
+    UHM_FREE(fill);
+    UHM_FREE(bounds);
+
+    // band is canvas seen through window of its rows, shapes draw at their canvas coordinates
+    int e = 0;
+    for(size_t b = 0; b < bandCount && e >= 0; b++){
+        uhm_target target = uhm_make_target(band, width, height);
+        target.clip.y0 = (int32_t)(b * bandHeight);
+        target.clip.y1 = target.clip.y0 + bandHeight < height ? target.clip.y0 + (int32_t)bandHeight : (int32_t)height;
+        target.originY = target.clip.y0;
+        uhm_target_fill(&target, program->backgroundColor);
+
+        for(size_t k = bandStart[b]; k < bandStart[b + 1] && e >= 0; k++){
+            e = uhm_draw_item(program, bandItems[k], &target);
         }
-
-        if(instruction.data) UHM_FREE(instruction.data);
+        if(e >= 0) e = onBand(user, band, target.clip.y0, target.clip.y1 - target.clip.y0);
     }
 
-    return output_data;
+    UHM_FREE(bandStart);
+    UHM_FREE(bandItems);
+    UHM_FREE(band);
+    return e < 0 ? e : 0;
+}
+
+int uhm_encode_banded(char* data, uint32_t size, uint32_t width, uint32_t height, uint32_t bandHeight, uhm_band_fn onBand, void* user){
+    uhm_program* program = uhm_compile(data, size);
+    if(program == NULL) return -1;
+    int e = uhm_render_banded(program, width, height, bandHeight, onBand, user);
+    uhm_program_free(program);
+    return e;
 }
 
 #endif